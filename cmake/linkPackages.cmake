@@ -1,3 +1,6 @@
+find_package(Threads REQUIRED)
+target_link_libraries(${PROJECT_NAME} PRIVATE Threads::Threads)
+
 find_package(spdlog CONFIG REQUIRED)
 target_link_libraries(${PROJECT_NAME} PRIVATE spdlog::spdlog)
 
@@ -6,6 +9,8 @@ target_link_libraries(${PROJECT_NAME} PRIVATE $<IF:$<TARGET_EXISTS:flecs::flecs>
 
 find_package(glm CONFIG REQUIRED)
 target_link_libraries(${PROJECT_NAME} PRIVATE glm::glm)
+# vulkan clip space depth is 0..1, every user of the engine headers has to agree
+target_compile_definitions(${PROJECT_NAME} PUBLIC GLM_FORCE_DEPTH_ZERO_TO_ONE)
 
 find_package(SDL2 CONFIG REQUIRED)
 target_link_libraries(${PROJECT_NAME}
@@ -26,6 +31,9 @@ target_link_libraries(${PROJECT_NAME} PRIVATE Vulkan::Vulkan GPUOpen::VulkanMemo
 find_package(fastgltf CONFIG REQUIRED)
 target_link_libraries(${PROJECT_NAME} PRIVATE fastgltf::fastgltf)
 
+find_package(meshoptimizer CONFIG REQUIRED)
+target_link_libraries(${PROJECT_NAME} PRIVATE meshoptimizer::meshoptimizer)
+
 find_package(imgui REQUIRED)
 target_link_libraries(${PROJECT_NAME} PRIVATE imgui::imgui)
 
@@ -1,13 +1,24 @@
-﻿#include <iostream>
+﻿#include <cstdint>
+#include <iostream>
 #include <memory>
 #include <stdexcept>
+#include <string>
+#include <string_view>
 
 #include "IController.h"
 
-int main([[maybe_unused]] int argc, [[maybe_unused]] char* args[]) {
+int main(int argc, char* args[]) {
     try {
         const auto controller = createInstance();
-        controller->init();
+
+        // --headless [frames]: render offscreen and report throughput
+        if (argc > 1 && std::string_view(args[1]) == "--headless") {
+            const auto frames = static_cast<uint32_t>(
+                    argc > 2 ? std::stoul(args[2]) : 1000);
+            controller->runHeadless(frames);
+        } else {
+            controller->init();
+        }
     } catch (const std::runtime_error& e) {
         std::cerr << "Unhandled exception: " << e.what() << '\n';
     }
@@ -48,6 +48,18 @@ public:
      */
     virtual void processEvent(SDL_Event &e) const = 0;
 
+    /*!
+     * \brief Renders a fixed number of frames without a window.
+     *
+     * \param frameCount Number of frames to render.
+     *
+     * This method initializes rendering in headless mode, renders the demo
+     * scene frameCount times and logs the achieved frame throughput. Needs
+     * no display, so it can run on CI machines with a software Vulkan
+     * driver.
+     */
+    virtual void runHeadless(uint32_t frameCount) const = 0;
+
     /*!
      * \brief Sends data to change the brightness of the backlight.
      *
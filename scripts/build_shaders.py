@@ -11,12 +11,15 @@ else:
 print("Shader builder working directory: " + project_dir)
 
 for filename in os.listdir(project_dir + "/shaders/"):
-    if filename.endswith(".vert") or filename.endswith(".frag") or filename.endswith(".comp"):
+    if filename.endswith((".vert", ".frag", ".comp", ".task", ".mesh")):
         shader_file_path = os.path.join(project_dir + "/shaders/", filename)
 
         output_file = os.path.splitext(shader_file_path)[0] + os.path.splitext(shader_file_path)[1] + ".spv"
 
         command = [glslc_executable, shader_file_path, "-o", output_file]
+        # task and mesh shaders need SPIR-V 1.4
+        if filename.endswith((".task", ".mesh")):
+            command.insert(1, "--target-env=vulkan1.3")
 
         try:
             subprocess.run(command, check=True)
@@ -1,33 +1,25 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "vertex_packing.glsl"
 
 layout (location = 0) out vec3 outColor;
 layout (location = 1) out vec2 outUV;
 
-struct Vertex {
-
-	vec3 position;
-	float uv_x;
-	vec3 normal;
-	float uv_y;
-	vec4 color;
-};
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-	Vertex vertices[];
-};
-
 //push constants block
 layout( push_constant ) uniform constants
 {
 	mat4 render_matrix;
-	VertexBuffer vertexBuffer;
+	vec4 positionDequant;
+	uvec2 vertexBuffer;
 } PushConstants;
 
 void main()
 {
 	//load vertex data from device adress
-	Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+	Vertex v = load_vertex(PushConstants.vertexBuffer, PushConstants.positionDequant, gl_VertexIndex);
 
 	//output data
 	gl_Position = PushConstants.render_matrix *vec4(v.position, 1.0f);
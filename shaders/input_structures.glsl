@@ -1,3 +1,5 @@
+#extension GL_EXT_nonuniform_qualifier : require
+
 layout(set = 0, binding = 0) uniform  SceneData{
 
     mat4 view;
@@ -8,12 +10,21 @@ layout(set = 0, binding = 0) uniform  SceneData{
     vec4 sunlightColor;
 } sceneData;
 
-layout(set = 1, binding = 0) uniform GLTFMaterialData{
+//bindless table, see vk_bindless.h
+struct Material {
 
     vec4 colorFactors;
     vec4 metal_rough_factors;
+    uint colorImage;
+    uint colorSampler;
+    uint metalRoughImage;
+    uint metalRoughSampler;
+};
+
+layout(set = 1, binding = 0) uniform texture2D bindlessImages[];
+layout(set = 1, binding = 1) uniform sampler bindlessSamplers[];
 
-} materialData;
+layout(set = 1, binding = 2, std430) readonly buffer Materials{
 
-layout(set = 1, binding = 1) uniform sampler2D colorTex;
-layout(set = 1, binding = 2) uniform sampler2D metalRoughTex;
\ No newline at end of file
+    Material materials[];
+} materialTable;
@@ -6,6 +6,7 @@
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inUV;
+layout (location = 3) flat in uint inMaterial;
 
 layout (location = 0) out vec4 outFragColor;
 
@@ -13,7 +14,9 @@ void main()
 {
     float lightValue = max(dot(inNormal, sceneData.sunlightDirection.xyz), 0.1f);
 
-    vec3 color = inColor * texture(colorTex,inUV).xyz;
+    Material material = materialTable.materials[inMaterial];
+    vec3 color = inColor * texture(sampler2D(bindlessImages[nonuniformEXT(material.colorImage)],
+                                             bindlessSamplers[nonuniformEXT(material.colorSampler)]), inUV).xyz;
     vec3 ambient = color *  sceneData.ambientColor.xyz;
 
     outFragColor = vec4(color * lightValue *  sceneData.sunlightColor.w + ambient ,1.0f);
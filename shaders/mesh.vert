@@ -2,43 +2,46 @@
 
 #extension GL_GOOGLE_include_directive : require
 #extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
 
 #include "input_structures.glsl"
+#include "vertex_packing.glsl"
+
+//the depth prepass and the color pass must produce identical depth
+invariant gl_Position;
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outMaterial;
 
-struct Vertex {
-
-    vec3 position;
-    float uv_x;
-    vec3 normal;
-    float uv_y;
-    vec4 color;
-};
-
-layout(buffer_reference, std430) readonly buffer VertexBuffer{
-    Vertex vertices[];
+//world matrix per instance as its first three rows, see pack_transform in
+//vk_types.h. gl_InstanceIndex includes the firstInstance of the draw
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{
+    mat3x4 matrices[];
 };
 
 //push constants block
 layout( push_constant ) uniform constants
 {
-    mat4 render_matrix;
-    VertexBuffer vertexBuffer;
+    vec4 positionDequant;
+    uvec2 vertexBuffer;
+    InstanceBuffer instanceBuffer;
+    uint materialIndex;
 } PushConstants;
 
 void main()
 {
-    Vertex v = PushConstants.vertexBuffer.vertices[gl_VertexIndex];
+    Vertex v = load_vertex(PushConstants.vertexBuffer, PushConstants.positionDequant, gl_VertexIndex);
+    mat3x4 render_matrix = PushConstants.instanceBuffer.matrices[gl_InstanceIndex];
 
-    vec4 position = vec4(v.position, 1.0f);
+    vec4 position = vec4(vec4(v.position, 1.0f) * render_matrix, 1.0f);
 
-    gl_Position =  sceneData.viewproj * PushConstants.render_matrix *position;
+    gl_Position =  sceneData.viewproj * position;
 
-    outNormal = (PushConstants.render_matrix * vec4(v.normal, 0.f)).xyz;
-    outColor = v.color.xyz * materialData.colorFactors.xyz;
+    outNormal = vec4(v.normal, 0.f) * render_matrix;
+    outColor = v.color.xyz * materialTable.materials[PushConstants.materialIndex].colorFactors.xyz;
     outUV.x = v.uv_x;
     outUV.y = v.uv_y;
+    outMaterial = PushConstants.materialIndex;
 }
\ No newline at end of file
@@ -0,0 +1,54 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_EXT_buffer_reference_uvec2 : require
+
+#include "input_structures.glsl"
+#include "vertex_packing.glsl"
+
+//the depth prepass and the color pass must produce identical depth
+invariant gl_Position;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) flat out uint outMaterial;
+
+//per-draw record, see GPUDrawData in vk_types.h
+struct DrawData {
+
+    mat3x4 render_matrix;
+    vec4 boundingSphere;
+    vec4 positionDequant;
+    uvec2 vertexBuffer;
+    uint materialIndex;
+    uint batch;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer{
+    DrawData draws[];
+};
+
+//push constants block
+layout( push_constant ) uniform constants
+{
+    DrawDataBuffer drawData;
+} PushConstants;
+
+void main()
+{
+    //each indirect command carries its draw index in firstInstance
+    DrawData draw = PushConstants.drawData.draws[gl_InstanceIndex];
+    Vertex v = load_vertex(draw.vertexBuffer, draw.positionDequant, gl_VertexIndex);
+
+    vec4 position = vec4(vec4(v.position, 1.0f) * draw.render_matrix, 1.0f);
+
+    gl_Position =  sceneData.viewproj * position;
+
+    outNormal = vec4(v.normal, 0.f) * draw.render_matrix;
+    outColor = v.color.xyz * materialTable.materials[draw.materialIndex].colorFactors.xyz;
+    outUV.x = v.uv_x;
+    outUV.y = v.uv_y;
+    outMaterial = draw.materialIndex;
+}
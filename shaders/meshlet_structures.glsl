@@ -0,0 +1,56 @@
+//meshlet inputs shared by mesh.task and mesh.mesh, see GPUMeshlet and
+//GPUMeshletPushConstants in vk_types.h. Needs GL_EXT_buffer_reference_uvec2
+
+//meshlets per task workgroup, MESHLET_TASK_GROUP in vk_types.h
+#define TASK_GROUP_SIZE 32
+
+struct Meshlet {
+
+    vec4 boundingSphere;
+    vec4 coneApex;
+    vec4 coneAxis; //w is the cone cutoff
+    uint vertexOffset;
+    uint triangleOffset;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletBuffer{
+    Meshlet meshlets[];
+};
+
+layout(buffer_reference, std430) readonly buffer MeshletVertexBuffer{
+    uint indices[];
+};
+
+//three byte vertex indices per triangle, read as words
+layout(buffer_reference, std430) readonly buffer MeshletTriangleBuffer{
+    uint words[];
+};
+
+//world matrix per instance as its first three rows, like mesh.vert
+layout(buffer_reference, std430) readonly buffer InstanceBuffer{
+    mat3x4 matrices[];
+};
+
+layout( push_constant ) uniform constants
+{
+    vec4 positionDequant;
+    uvec2 vertexBuffer;
+    InstanceBuffer instanceBuffer;
+    MeshletBuffer meshlets;
+    MeshletVertexBuffer meshletVertices;
+    MeshletTriangleBuffer meshletTriangles;
+    uint materialIndex;
+    uint firstMeshlet;
+    uint meshletCount;
+    uint firstInstance;
+    uint coneCull;
+} PushConstants;
+
+//meshlets that survived culling, one mesh workgroup each
+struct TaskPayload {
+
+    uint instance;
+    uint meshlets[TASK_GROUP_SIZE];
+};
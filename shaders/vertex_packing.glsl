@@ -0,0 +1,59 @@
+//vertex layouts of the mesh buffers, see Vertex and PackedVertex in
+//vk_types.h. Needs GL_EXT_buffer_reference_uvec2
+
+struct Vertex {
+
+    vec3 position;
+    float uv_x;
+    vec3 normal;
+    float uv_y;
+    vec4 color;
+};
+
+layout(buffer_reference, std430) readonly buffer VertexBuffer{
+    Vertex vertices[];
+};
+
+//snorm16 position relative to the mesh bounds, octahedral snorm16 normal,
+//half float uv and unorm8 color
+struct PackedVertex {
+
+    uint positionXY;
+    uint positionZ;
+    uint normal;
+    uint uv;
+    uint color;
+};
+
+layout(buffer_reference, std430) readonly buffer PackedVertexBuffer{
+    PackedVertex vertices[];
+};
+
+vec3 decode_octahedral(vec2 e)
+{
+    vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
+
+//positionDequant is GPUMeshBuffers::positionDequant, a w of 0 marks the
+//float layout
+Vertex load_vertex(uvec2 address, vec4 positionDequant, uint index)
+{
+    if (positionDequant.w == 0.0f) {
+        return VertexBuffer(address).vertices[index];
+    }
+
+    PackedVertex p = PackedVertexBuffer(address).vertices[index];
+    Vertex v;
+    vec3 position = vec3(unpackSnorm2x16(p.positionXY), unpackSnorm2x16(p.positionZ).x);
+    v.position = positionDequant.xyz + position * positionDequant.w;
+    v.normal = decode_octahedral(unpackSnorm2x16(p.normal));
+    vec2 uv = unpackHalf2x16(p.uv);
+    v.uv_x = uv.x;
+    v.uv_y = uv.y;
+    v.color = unpackUnorm4x8(p.color);
+    return v;
+}
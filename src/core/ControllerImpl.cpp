@@ -8,6 +8,7 @@
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/transform.hpp>
 
+#include "core/Logging.h"
 #include "core/View.h"
 #include "scene/Camera.h"
 
@@ -56,6 +57,26 @@ void ControllerImpl::processEvent(SDL_Event &e) const {
     _model->getCamera()->processSDLEvent(e);
 }
 
+void ControllerImpl::runHeadless(uint32_t frameCount) const {
+    _model->registerHeadless(1920, 1080);
+
+    for (int i = 0; i < 5; i++) {
+        _model->createMesh("cube" + std::to_string(i));
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    for (uint32_t i = 0; i < frameCount; i++) {
+        update();
+    }
+
+    const std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - start;
+
+    LOGI("Rendered {} headless frames in {:.3f} s ({:.1f} FPS)", frameCount,
+         elapsed.count(), frameCount / elapsed.count())
+}
+
 void ControllerImpl::init() const {
     const auto controller = shared_from_this();
     const auto view = createView(controller, _model);
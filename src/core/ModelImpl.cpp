@@ -15,6 +15,15 @@ void ModelImpl::registerWindow(SDL_Window *window) {
     _engine.init(window);
 }
 
+void ModelImpl::registerHeadless(uint32_t width, uint32_t height) {
+    EngineConfig config;
+    config.headless = true;
+    config.headlessExtent = {width, height};
+
+    _engine.mainCamera = &_camera;
+    _engine.init(nullptr, config);
+}
+
 void ModelImpl::updateVulkan() {
     _engine.update();
 }
@@ -0,0 +1,110 @@
+#include "core/ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    if (threadCount == 0) {
+        threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        threadCount = std::max(threadCount, 1u);
+    }
+
+    _workers.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++) {
+        _workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _condition.notify_all();
+
+    for (std::thread& worker : _workers) {
+        worker.join();
+    }
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> job) {
+    std::packaged_task<void()> task(std::move(job));
+    std::future<void> result = task.get_future();
+    {
+        std::lock_guard lock(_mutex);
+        _jobs.push(std::move(task));
+    }
+    _condition.notify_one();
+    return result;
+}
+
+void ThreadPool::parallelFor(uint32_t count,
+                             const std::function<void(uint32_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    // indices are handed out dynamically so uneven chunks balance out
+    std::atomic<uint32_t> next{0};
+    const auto drain = [&] {
+        try {
+            for (uint32_t i = next++; i < count; i = next++) {
+                task(i);
+            }
+        } catch (...) {
+            // a failure stops handing out indices on every thread
+            next = count;
+            throw;
+        }
+    };
+
+    const uint32_t helperCount = std::min(size(), count - 1);
+    std::vector<std::future<void>> helpers;
+    helpers.reserve(helperCount);
+    for (uint32_t i = 0; i < helperCount; i++) {
+        helpers.push_back(submit(drain));
+    }
+
+    // the helpers reference next and drain, so they have to finish before
+    // an exception leaves this frame
+    std::exception_ptr failure;
+    try {
+        drain();
+    } catch (...) {
+        failure = std::current_exception();
+    }
+
+    for (std::future<void>& helper : helpers) {
+        helper.wait();
+    }
+    for (std::future<void>& helper : helpers) {
+        try {
+            helper.get();
+        } catch (...) {
+            if (!failure) {
+                failure = std::current_exception();
+            }
+        }
+    }
+
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    while (true) {
+        std::packaged_task<void()> job;
+        {
+            std::unique_lock lock(_mutex);
+            _condition.wait(lock, [this] { return _stopping || !_jobs.empty(); });
+            if (_stopping && _jobs.empty()) {
+                return;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop();
+        }
+        job();
+    }
+}
@@ -83,6 +83,59 @@ void ViewImpl::run() const {
         if (ImGui::Begin("background")) {
             VulkanEngine &engine = VulkanEngine::Get();
             ImGui::SliderFloat("Render Scale", &engine.renderScale, 0.3f, 1.f);
+
+            int framesInFlight = static_cast<int>(engine._framesInFlight);
+            if (ImGui::SliderInt("Frames in flight", &framesInFlight, 1,
+                                 MAX_FRAMES_IN_FLIGHT)) {
+                engine.set_frames_in_flight(
+                        static_cast<uint32_t>(framesInFlight));
+            }
+
+            constexpr VkPresentModeKHR presentModes[] = {
+                    VK_PRESENT_MODE_FIFO_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR,
+                    VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+            constexpr const char* presentModeNames[] = {
+                    "FIFO", "FIFO relaxed", "Mailbox", "Immediate"};
+            int presentMode = 0;
+            for (int i = 0; i < 4; i++) {
+                if (presentModes[i] == engine._config.presentMode) {
+                    presentMode = i;
+                }
+            }
+            if (ImGui::Combo("Present mode", &presentMode, presentModeNames,
+                             4)) {
+                engine.set_present_mode(presentModes[presentMode]);
+            }
+            ImGui::Checkbox("Low latency", &engine._config.lowLatency);
+            ImGui::Checkbox("Async compute", &engine._config.asyncCompute);
+            ImGui::Checkbox("Indirect draw", &engine._config.indirectDraw);
+            ImGui::Checkbox("GPU culling", &engine._config.gpuCulling);
+            ImGui::Checkbox("Occlusion culling",
+                            &engine._config.occlusionCulling);
+            ImGui::Checkbox("CPU culling", &engine._config.cpuCulling);
+            ImGui::SliderFloat("Min screen size",
+                               &engine._config.cullMinScreenSize, 0.f, 0.1f);
+            ImGui::Checkbox("Depth prepass", &engine._config.depthPrepass);
+            ImGui::SliderFloat("LOD error (px)",
+                               &engine._config.lodErrorPixels, 0.f, 8.f);
+            if (engine._meshShaderSupported) {
+                ImGui::Checkbox("Mesh shading", &engine._config.meshShading);
+            }
+
+            ImGui::Text("frametime %.2f ms", engine.stats.frametime);
+            ImGui::Text("frame wait %.2f ms", engine.stats.fenceWaitTime);
+            ImGui::Text("surfaces %u / %u", engine.stats.visibleCount,
+                        engine.stats.surfaceCount);
+            ImGui::Text("draws %u", engine.stats.drawCount);
+            ImGui::Text("triangles %u", engine.stats.triangleCount);
+            const GeometryBuffer& geometry = engine.geometry_buffer;
+            ImGui::Text("geometry %.1f / %.1f MB, %.0f%% holes",
+                        geometry.vertex_used() / (1024.f * 1024.f),
+                        geometry.vertex_capacity() / (1024.f * 1024.f),
+                        geometry.fragmentation() * 100.f);
+            if (ImGui::Button("Compact geometry")) {
+                engine.compact_geometry();
+            }
             // other code
         }
         ImGui::End();
@@ -11,8 +11,14 @@ void ComputePipeline::init(VkDevice device) {
     VkPipelineLayoutCreateInfo computeLayout{};
     computeLayout.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     computeLayout.pNext = nullptr;
-    computeLayout.pSetLayouts = &_config.descriptorSetLayout;
-    computeLayout.setLayoutCount = 1;
+    if (_config.descriptorSetLayout != VK_NULL_HANDLE) {
+        computeLayout.pSetLayouts = &_config.descriptorSetLayout;
+        computeLayout.setLayoutCount = 1;
+    }
+    if (!_config.pushConstants.empty()) {
+        computeLayout.pushConstantRangeCount = static_cast<uint32_t>(_config.pushConstants.size());
+        computeLayout.pPushConstantRanges = _config.pushConstants.data();
+    }
 
     VK_CHECK(vkCreatePipelineLayout(_device, &computeLayout, nullptr, &_pipelineLayout));
     
@@ -55,6 +61,10 @@ void ComputePipeline::bindDescriptorSets(VkCommandBuffer cmd, const VkDescriptor
                            0, setCount, descriptorSets, 0, nullptr);
 }
 
+void ComputePipeline::pushConstants(VkCommandBuffer cmd, uint32_t offset, uint32_t size, const void* data) {
+    vkCmdPushConstants(cmd, _pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, offset, size, data);
+}
+
 void ComputePipeline::dispatch(VkCommandBuffer cmd, uint32_t x, uint32_t y, uint32_t z) {
     vkCmdDispatch(cmd, x, y, z);
 }
@@ -1,4 +1,5 @@
 #include "graphics/vulkan/pipelines.h"
+#include "graphics/vulkan/vk_bindless.h"
 #include "graphics/vulkan/vk_engine.h"
 
 void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine) {
@@ -6,19 +7,88 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine) {
             load_shader(engine, "./shaders/mesh.frag.spv", "fragment");
     VkShaderModule meshVertexShader =
             load_shader(engine, "./shaders/mesh.vert.spv", "vertex");
+    VkShaderModule indirectVertexShader =
+            load_shader(engine, "./shaders/mesh_indirect.vert.spv", "vertex");
 
-    create_material_layout(engine);
-    VkPipelineLayout newLayout = create_pipeline_layout(engine);
+    VkPipelineLayout newLayout = create_pipeline_layout(
+            engine, VK_SHADER_STAGE_VERTEX_BIT,
+            sizeof(GPUInstancedPushConstants));
 
     opaquePipeline.layout = newLayout;
     transparentPipeline.layout = newLayout;
+    opaqueIndirectPipeline.layout = newLayout;
+    transparentIndirectPipeline.layout = newLayout;
+    opaqueDepthPipeline.layout = newLayout;
+    opaqueDepthIndirectPipeline.layout = newLayout;
+    opaquePipeline.cullMode = CULL_MODE;
+    opaqueIndirectPipeline.cullMode = CULL_MODE;
+    opaqueDepthPipeline.cullMode = CULL_MODE;
+    opaqueDepthIndirectPipeline.cullMode = CULL_MODE;
 
-    build_opaque_pipeline(engine, meshVertexShader, meshFragShader, newLayout);
-    build_transparent_pipeline(engine, meshVertexShader, meshFragShader,
-                               newLayout);
+    opaquePipeline.pipeline = build_opaque_pipeline(
+            engine, {.vertex = meshVertexShader}, meshFragShader, newLayout);
+    transparentPipeline.pipeline = build_transparent_pipeline(
+            engine, {.vertex = meshVertexShader}, meshFragShader, newLayout);
+    opaqueIndirectPipeline.pipeline = build_opaque_pipeline(
+            engine, {.vertex = indirectVertexShader}, meshFragShader,
+            newLayout);
+    transparentIndirectPipeline.pipeline = build_transparent_pipeline(
+            engine, {.vertex = indirectVertexShader}, meshFragShader,
+            newLayout);
+    opaqueDepthPipeline.pipeline = build_depth_pipeline(
+            engine, {.vertex = meshVertexShader}, newLayout);
+    opaqueDepthIndirectPipeline.pipeline = build_depth_pipeline(
+            engine, {.vertex = indirectVertexShader}, newLayout);
+
+    if (engine->_meshShaderSupported) {
+        build_meshlet_pipelines(engine, meshFragShader);
+    }
 
     vkDestroyShaderModule(engine->_device, meshFragShader, nullptr);
     vkDestroyShaderModule(engine->_device, meshVertexShader, nullptr);
+    vkDestroyShaderModule(engine->_device, indirectVertexShader, nullptr);
+}
+
+void GLTFMetallic_Roughness::build_meshlet_pipelines(
+        VulkanEngine* engine, VkShaderModule fragShader) {
+    VkShaderModule taskShader =
+            load_shader(engine, "./shaders/mesh.task.spv", "task");
+    VkShaderModule meshShader =
+            load_shader(engine, "./shaders/mesh.mesh.spv", "mesh");
+
+    // both stages read the meshlet push constants
+    VkPipelineLayout meshletLayout = create_pipeline_layout(
+            engine, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+            sizeof(GPUMeshletPushConstants));
+
+    opaqueMeshletPipeline.layout = meshletLayout;
+    transparentMeshletPipeline.layout = meshletLayout;
+    opaqueDepthMeshletPipeline.layout = meshletLayout;
+    opaqueMeshletPipeline.cullMode = CULL_MODE;
+    opaqueDepthMeshletPipeline.cullMode = CULL_MODE;
+
+    const GeometryShaders geometry{.task = taskShader, .mesh = meshShader};
+    opaqueMeshletPipeline.pipeline = build_opaque_pipeline(
+            engine, geometry, fragShader, meshletLayout);
+    transparentMeshletPipeline.pipeline = build_transparent_pipeline(
+            engine, geometry, fragShader, meshletLayout);
+    opaqueDepthMeshletPipeline.pipeline =
+            build_depth_pipeline(engine, geometry, meshletLayout);
+
+    vkDestroyShaderModule(engine->_device, taskShader, nullptr);
+    vkDestroyShaderModule(engine->_device, meshShader, nullptr);
+}
+
+const MaterialPipeline& GLTFMetallic_Roughness::indirect_pipeline(
+        const MaterialPipeline* pipeline) const {
+    return pipeline == &transparentPipeline ? transparentIndirectPipeline
+                                            : opaqueIndirectPipeline;
+}
+
+const MaterialPipeline& GLTFMetallic_Roughness::meshlet_pipeline(
+        const MaterialPipeline* pipeline) const {
+    return pipeline == &transparentPipeline ? transparentMeshletPipeline
+                                            : opaqueMeshletPipeline;
 }
 
 VkShaderModule GLTFMetallic_Roughness::load_shader(VulkanEngine* engine,
@@ -32,26 +102,16 @@ VkShaderModule GLTFMetallic_Roughness::load_shader(VulkanEngine* engine,
     return shaderModule;
 }
 
-void GLTFMetallic_Roughness::create_material_layout(VulkanEngine* engine) {
-    DescriptorLayoutBuilder layoutBuilder;
-    layoutBuilder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    layoutBuilder.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    layoutBuilder.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-    materialLayout = layoutBuilder.build(
-            engine->_device,
-            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
-}
-
 VkPipelineLayout GLTFMetallic_Roughness::create_pipeline_layout(
-        VulkanEngine* engine) {
+        VulkanEngine* engine, VkShaderStageFlags pushStages,
+        uint32_t pushSize) {
     VkPushConstantRange matrixRange{};
     matrixRange.offset = 0;
-    matrixRange.size = sizeof(GPUDrawPushConstants);
-    matrixRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    matrixRange.size = pushSize;
+    matrixRange.stageFlags = pushStages;
 
     VkDescriptorSetLayout layouts[] = {engine->_gpuSceneDataDescriptorLayout,
-                                       materialLayout};
+                                       engine->bindless_table.layout()};
     VkPipelineLayoutCreateInfo mesh_layout_info =
             vkinit::pipeline_layout_create_info();
     mesh_layout_info.setLayoutCount = 2;
@@ -66,15 +126,24 @@ VkPipelineLayout GLTFMetallic_Roughness::create_pipeline_layout(
     return newLayout;
 }
 
-void GLTFMetallic_Roughness::build_opaque_pipeline(VulkanEngine* engine,
-                                                   VkShaderModule vertexShader,
-                                                   VkShaderModule fragShader,
-                                                   VkPipelineLayout layout) {
+void GLTFMetallic_Roughness::set_shaders(PipelineBuilder& builder,
+                                         const GeometryShaders& geometry,
+                                         VkShaderModule fragShader) {
+    if (geometry.mesh != VK_NULL_HANDLE) {
+        builder.set_mesh_shaders(geometry.task, geometry.mesh, fragShader);
+    } else {
+        builder.set_shaders(geometry.vertex, fragShader);
+    }
+}
+
+VkPipeline GLTFMetallic_Roughness::build_opaque_pipeline(
+        VulkanEngine* engine, const GeometryShaders& geometry,
+        VkShaderModule fragShader, VkPipelineLayout layout) {
     PipelineBuilder pipelineBuilder;
-    pipelineBuilder.set_shaders(vertexShader, fragShader);
+    set_shaders(pipelineBuilder, geometry, fragShader);
     pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
     pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
-    pipelineBuilder.set_cull_mode(VK_CULL_MODE_NONE, VK_FRONT_FACE_CLOCKWISE);
+    pipelineBuilder.set_cull_mode(CULL_MODE, VK_FRONT_FACE_CLOCKWISE);
     pipelineBuilder.set_multisampling_none();
     pipelineBuilder.disable_blending();
     pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
@@ -82,54 +151,78 @@ void GLTFMetallic_Roughness::build_opaque_pipeline(VulkanEngine* engine,
     pipelineBuilder.set_depth_format(engine->_depthImage->get().imageFormat);
     pipelineBuilder._pipelineLayout = layout;
 
-    opaquePipeline.pipeline = pipelineBuilder.build_pipeline(engine->_device);
+    return pipelineBuilder.build_pipeline(engine->_device);
 }
 
-void GLTFMetallic_Roughness::build_transparent_pipeline(
-        VulkanEngine* engine, VkShaderModule vertexShader,
+VkPipeline GLTFMetallic_Roughness::build_transparent_pipeline(
+        VulkanEngine* engine, const GeometryShaders& geometry,
         VkShaderModule fragShader, VkPipelineLayout layout) {
     PipelineBuilder pipelineBuilder;
-    pipelineBuilder.set_shaders(vertexShader, fragShader);
+    set_shaders(pipelineBuilder, geometry, fragShader);
     pipelineBuilder.enable_blending_additive();
     pipelineBuilder.enable_depthtest(false, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    pipelineBuilder.set_color_attachment_format(engine->_drawImage->get().imageFormat);
+    pipelineBuilder.set_depth_format(engine->_depthImage->get().imageFormat);
+    pipelineBuilder._pipelineLayout = layout;
+
+    return pipelineBuilder.build_pipeline(engine->_device);
+}
+
+VkPipeline GLTFMetallic_Roughness::build_depth_pipeline(
+        VulkanEngine* engine, const GeometryShaders& geometry,
+        VkPipelineLayout layout) {
+    PipelineBuilder pipelineBuilder;
+    set_shaders(pipelineBuilder, geometry, VK_NULL_HANDLE);
+    pipelineBuilder.set_input_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+    pipelineBuilder.set_polygon_mode(VK_POLYGON_MODE_FILL);
+    pipelineBuilder.set_cull_mode(CULL_MODE, VK_FRONT_FACE_CLOCKWISE);
+    pipelineBuilder.set_multisampling_none();
+    pipelineBuilder.disable_color_writes();
+    pipelineBuilder.enable_depthtest(true, VK_COMPARE_OP_GREATER_OR_EQUAL);
+    pipelineBuilder.set_color_attachment_format(engine->_drawImage->get().imageFormat);
+    pipelineBuilder.set_depth_format(engine->_depthImage->get().imageFormat);
     pipelineBuilder._pipelineLayout = layout;
 
-    transparentPipeline.pipeline =
-            pipelineBuilder.build_pipeline(engine->_device);
+    return pipelineBuilder.build_pipeline(engine->_device);
 }
 
 MaterialInstance GLTFMetallic_Roughness::write_material(
-        VkDevice device, MaterialPass pass, const MaterialResources& resources,
-        DescriptorAllocatorGrowable& descriptorAllocator) {
+        MaterialPass pass, const MaterialResources& resources,
+        BindlessTable& table) {
     MaterialInstance matData{};
     matData.passType = pass;
     matData.pipeline = (pass == MaterialPass::Transparent)
                                ? &transparentPipeline
                                : &opaquePipeline;
-    matData.materialSet = descriptorAllocator.allocate(device, materialLayout);
-
-    writer.clear();
-    writer.write_buffer(0, resources.dataBuffer, sizeof(MaterialConstants),
-                        resources.dataBufferOffset,
-                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.write_image(1, resources.colorImage.imageView,
-                       resources.colorSampler,
-                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.write_image(2, resources.metalRoughImage.imageView,
-                       resources.metalRoughSampler,
-                       VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-    writer.update_set(device, matData.materialSet);
-    writer.update_set(device, matData.materialSet);
+
+    GPUMaterial material{};
+    material.colorFactors = resources.constants.colorFactors;
+    material.metalRoughFactors = resources.constants.metal_rough_factors;
+    material.colorImage = table.add_image(resources.colorImage.imageView);
+    material.colorSampler = table.add_sampler(resources.colorSampler);
+    material.metalRoughImage =
+            table.add_image(resources.metalRoughImage.imageView);
+    material.metalRoughSampler = table.add_sampler(resources.metalRoughSampler);
+
+    matData.materialIndex = table.add_material(material);
 
     return matData;
 }
 
+void GLTFMetallic_Roughness::release_material(const MaterialInstance& material,
+                                              BindlessTable& table) {
+    const GPUMaterial& record = table.material(material.materialIndex);
+    table.remove_image(record.colorImage);
+    table.remove_sampler(record.colorSampler);
+    table.remove_image(record.metalRoughImage);
+    table.remove_sampler(record.metalRoughSampler);
+    table.remove_material(material.materialIndex);
+}
+
 void Pipelines::init(VkDevice device,
                      VkDescriptorSetLayout singleImageDescriptorLayout,
                      VkDescriptorSetLayout drawImageDescriptorLayout,
+                     VkDescriptorSetLayout depthPyramidDescriptorLayout,
                      AllocatedImage drawImage) {
     _device = device;
     _singleImageDescriptorLayout = singleImageDescriptorLayout;
@@ -194,6 +287,17 @@ void Pipelines::init(VkDevice device,
     gradientPipeline = std::make_unique<ComputePipeline>(gradientConfig);
     gradientPipeline->init(device);
 
+    // Culling pipeline, samples the depth pyramid and takes all buffers by
+    // address
+    ComputePipeline::ComputePipelineConfig cullConfig;
+    cullConfig.descriptorSetLayout = depthPyramidDescriptorLayout;
+    cullConfig.shaderPath = "./shaders/cull.comp.spv";
+    cullConfig.pushConstants.push_back({VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                        sizeof(GPUCullPushConstants)});
+
+    cullPipeline = std::make_unique<ComputePipeline>(cullConfig);
+    cullPipeline->init(device);
+
     fmt::println("Pipelines initialized successfully");
 }
 
@@ -209,4 +313,8 @@ void Pipelines::destroy() {
     if (gradientPipeline) {
         gradientPipeline->destroy();
     }
+
+    if (cullPipeline) {
+        cullPipeline->destroy();
+    }
 }
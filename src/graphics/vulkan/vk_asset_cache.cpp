@@ -0,0 +1,102 @@
+#include "graphics/vulkan/vk_asset_cache.h"
+
+#include <fstream>
+#include <system_error>
+
+#include "core/Logging.h"
+#include "graphics/vulkan/vk_engine.h"
+#include "graphics/vulkan/vk_loader.h"
+
+namespace {
+// 64 bit FNV-1a over the file bytes, 0 when the file can't be read
+uint64_t content_hash(const std::filesystem::path& filePath) {
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    std::vector<char> chunk(64 * 1024);
+    while (file) {
+        file.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+        const std::streamsize count = file.gcount();
+        for (std::streamsize i = 0; i < count; i++) {
+            hash ^= static_cast<uint8_t>(chunk[i]);
+            hash *= 0x100000001b3ull;
+        }
+    }
+    return hash;
+}
+}  // namespace
+
+void AssetCache::init(VulkanEngine* vk_engine) {
+    _engine = vk_engine;
+}
+
+void AssetCache::cleanup() {
+    _retired.clear();
+    _hashes.clear();
+    _entries.clear();
+    _paths.clear();
+}
+
+std::shared_ptr<LoadedGLTF> AssetCache::acquire(
+        const std::filesystem::path& filePath) {
+    std::error_code error;
+    const uintmax_t fileSize = std::filesystem::file_size(filePath, error);
+    const auto writeTime = std::filesystem::last_write_time(filePath, error);
+    if (error) {
+        LOGE("Can't open mesh file {}: {}", filePath.string(),
+             error.message());
+        return nullptr;
+    }
+
+    // only hash the file when the path is new or the file changed since
+    auto path = _paths.find(filePath.string());
+    if (path == _paths.end() || path->second.fileSize != fileSize ||
+        path->second.writeTime != writeTime) {
+        const PathInfo info{content_hash(filePath), fileSize, writeTime};
+        path = _paths.insert_or_assign(filePath.string(), info).first;
+    }
+    const uint64_t hash = path->second.hash;
+
+    Entry& entry = _entries[hash];
+    if (!entry.scene) {
+        const auto scene = loadGltf(_engine, filePath.string());
+        if (!scene.has_value()) {
+            _entries.erase(hash);
+            return nullptr;
+        }
+        entry.scene = *scene;
+        _hashes[entry.scene.get()] = hash;
+    }
+
+    entry.refCount++;
+    return entry.scene;
+}
+
+void AssetCache::release(const std::shared_ptr<LoadedGLTF>& scene) {
+    const auto hash = _hashes.find(scene.get());
+    if (hash == _hashes.end()) {
+        return;
+    }
+
+    const auto entry = _entries.find(hash->second);
+    if (--entry->second.refCount > 0) {
+        return;
+    }
+
+    // frames already submitted may still draw the scene
+    _retired.push_back({std::move(entry->second.scene), _engine->_frameNumber});
+    _entries.erase(entry);
+    _hashes.erase(hash);
+}
+
+void AssetCache::collect() {
+    // once the current slot is free, every frame up to _framesInFlight ago
+    // has finished on the GPU
+    const uint64_t frame = _engine->_frameNumber;
+    std::erase_if(_retired, [&](const Retired& retired) {
+        return retired.frame + _engine->_framesInFlight <= frame;
+    });
+}
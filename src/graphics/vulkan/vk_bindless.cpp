@@ -0,0 +1,196 @@
+#include "graphics/vulkan/vk_bindless.h"
+
+#include <array>
+#include <cassert>
+
+#include "graphics/vulkan/vk_descriptors.h"
+#include "graphics/vulkan/vk_engine.h"
+
+namespace {
+constexpr uint32_t IMAGE_BINDING = 0;
+constexpr uint32_t SAMPLER_BINDING = 1;
+constexpr uint32_t MATERIAL_BINDING = 2;
+}  // namespace
+
+uint32_t BindlessTable::Slots::acquire(uint32_t capacity) {
+    uint32_t index;
+    if (!freeList.empty()) {
+        index = freeList.back();
+        freeList.pop_back();
+    } else {
+        if (next == capacity) {
+            LOGE("Bindless table is full ({} slots)", capacity);
+            assert(false);
+            return 0;
+        }
+        index = next++;
+        refCounts.push_back(0);
+    }
+    refCounts[index] = 1;
+    return index;
+}
+
+bool BindlessTable::Slots::release(uint32_t index) {
+    assert(refCounts[index] > 0);
+    if (--refCounts[index] > 0) {
+        return false;
+    }
+    freeList.push_back(index);
+    return true;
+}
+
+void BindlessTable::init(VulkanEngine* vk_engine) {
+    _engine = vk_engine;
+
+    DescriptorLayoutBuilder builder;
+    builder.add_binding(IMAGE_BINDING, VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+                        MAX_BINDLESS_IMAGES);
+    builder.add_binding(SAMPLER_BINDING, VK_DESCRIPTOR_TYPE_SAMPLER,
+                        MAX_BINDLESS_SAMPLERS);
+    builder.add_binding(MATERIAL_BINDING, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+    constexpr VkDescriptorBindingFlags bindingFlags =
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    const std::array<VkDescriptorBindingFlags, 3> flags{
+            bindingFlags, bindingFlags, bindingFlags};
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    flagsInfo.bindingCount = static_cast<uint32_t>(flags.size());
+    flagsInfo.pBindingFlags = flags.data();
+
+    VkShaderStageFlags stages =
+            VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+    // mesh shaders read the material constants like vertex shaders do
+    if (_engine->_meshShaderSupported) {
+        stages |= VK_SHADER_STAGE_MESH_BIT_EXT;
+    }
+
+    _layout = builder.build(_engine->_device, stages, &flagsInfo,
+            VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
+
+    const std::array<VkDescriptorPoolSize, 3> poolSizes{{
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, MAX_BINDLESS_IMAGES},
+            {VK_DESCRIPTOR_TYPE_SAMPLER, MAX_BINDLESS_SAMPLERS},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1},
+    }};
+
+    VkDescriptorPoolCreateInfo poolInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    VK_CHECK(vkCreateDescriptorPool(_engine->_device, &poolInfo, nullptr,
+                                    &_pool));
+
+    VkDescriptorSetAllocateInfo allocInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    allocInfo.descriptorPool = _pool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &_layout;
+    VK_CHECK(vkAllocateDescriptorSets(_engine->_device, &allocInfo, &_set));
+
+    // host visible so materials are written in place, slots are only
+    // written while no frame references them
+    _materialBuffer = _engine->create_buffer(
+            sizeof(GPUMaterial) * MAX_BINDLESS_MATERIALS,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    _materials = static_cast<GPUMaterial*>(_materialBuffer.info.pMappedData);
+
+    DescriptorWriter writer;
+    writer.write_buffer(MATERIAL_BINDING, _materialBuffer.buffer,
+                        VK_WHOLE_SIZE, 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    writer.update_set(_engine->_device, _set);
+
+    _images.resize(MAX_BINDLESS_IMAGES, VK_NULL_HANDLE);
+    _samplers.resize(MAX_BINDLESS_SAMPLERS, VK_NULL_HANDLE);
+}
+
+void BindlessTable::cleanup() {
+    if (_pool == VK_NULL_HANDLE) {
+        return;
+    }
+    _engine->destroy_buffer(_materialBuffer);
+    vkDestroyDescriptorPool(_engine->_device, _pool, nullptr);
+    vkDestroyDescriptorSetLayout(_engine->_device, _layout, nullptr);
+    _pool = VK_NULL_HANDLE;
+}
+
+uint32_t BindlessTable::add_image(VkImageView view) {
+    if (const auto it = _imageIndices.find(view); it != _imageIndices.end()) {
+        _imageSlots.refCounts[it->second]++;
+        return it->second;
+    }
+
+    const uint32_t index = _imageSlots.acquire(MAX_BINDLESS_IMAGES);
+    _imageIndices[view] = index;
+    _images[index] = view;
+
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageView = view;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = _set;
+    write.dstBinding = IMAGE_BINDING;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(_engine->_device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void BindlessTable::remove_image(uint32_t index) {
+    if (_imageSlots.release(index)) {
+        _imageIndices.erase(_images[index]);
+        _images[index] = VK_NULL_HANDLE;
+    }
+}
+
+uint32_t BindlessTable::add_sampler(VkSampler sampler) {
+    if (const auto it = _samplerIndices.find(sampler);
+        it != _samplerIndices.end()) {
+        _samplerSlots.refCounts[it->second]++;
+        return it->second;
+    }
+
+    const uint32_t index = _samplerSlots.acquire(MAX_BINDLESS_SAMPLERS);
+    _samplerIndices[sampler] = index;
+    _samplers[index] = sampler;
+
+    VkDescriptorImageInfo samplerInfo{};
+    samplerInfo.sampler = sampler;
+
+    VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = _set;
+    write.dstBinding = SAMPLER_BINDING;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_SAMPLER;
+    write.pImageInfo = &samplerInfo;
+    vkUpdateDescriptorSets(_engine->_device, 1, &write, 0, nullptr);
+
+    return index;
+}
+
+void BindlessTable::remove_sampler(uint32_t index) {
+    if (_samplerSlots.release(index)) {
+        _samplerIndices.erase(_samplers[index]);
+        _samplers[index] = VK_NULL_HANDLE;
+    }
+}
+
+uint32_t BindlessTable::add_material(const GPUMaterial& material) {
+    const uint32_t index = _materialSlots.acquire(MAX_BINDLESS_MATERIALS);
+    _materials[index] = material;
+    return index;
+}
+
+void BindlessTable::remove_material(uint32_t index) {
+    _materialSlots.release(index);
+}
@@ -20,11 +20,52 @@ void CommandBuffers::init_commands(VulkanEngine* vk_engine) {
         _frame._commandPool = std::make_unique<VulkanCommandPool>(vk_engine->_device, commandPool);
 
         // allocate the default command buffer that we will use for rendering
+        // and the one for the present part of a split (low latency) frame
         VkCommandBufferAllocateInfo cmdAllocInfo =
-                vkinit::command_buffer_allocate_info(_frame._commandPool->get(), 1);
+                vkinit::command_buffer_allocate_info(_frame._commandPool->get(), 2);
 
+        VkCommandBuffer buffers[2];
         VK_CHECK(vkAllocateCommandBuffers(vk_engine->_device, &cmdAllocInfo,
-                                          &_frame._mainCommandBuffer));
+                                          buffers));
+        _frame._mainCommandBuffer = buffers[0];
+        _frame._presentCommandBuffer = buffers[1];
+
+        const VkCommandPoolCreateInfo computePoolInfo =
+                vkinit::command_pool_create_info(
+                        vk_engine->_computeQueueFamily,
+                        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VkCommandPool computePool;
+        VK_CHECK(vkCreateCommandPool(vk_engine->_device, &computePoolInfo,
+                                     nullptr, &computePool));
+        _frame._computeCommandPool =
+                std::make_unique<VulkanCommandPool>(vk_engine->_device, computePool);
+
+        const VkCommandBufferAllocateInfo computeAllocInfo =
+                vkinit::command_buffer_allocate_info(computePool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(vk_engine->_device, &computeAllocInfo,
+                                          &_frame._computeCommandBuffer));
+
+        // the recording thread also takes a chunk, hence the extra pool
+        const uint32_t chunkCount = vk_engine->_workerPool->size() + 1;
+        const VkCommandPoolCreateInfo workerPoolInfo =
+                vkinit::command_pool_create_info(vk_engine->_graphicsQueueFamily,
+                                                 VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+        for (uint32_t i = 0; i < chunkCount; i++) {
+            VkCommandPool workerPool;
+            VK_CHECK(vkCreateCommandPool(vk_engine->_device, &workerPoolInfo,
+                                         nullptr, &workerPool));
+            _frame._workerCommandPools.push_back(
+                    std::make_unique<VulkanCommandPool>(vk_engine->_device, workerPool));
+
+            VkCommandBufferAllocateInfo secondaryAllocInfo =
+                    vkinit::command_buffer_allocate_info(workerPool, 1);
+            secondaryAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+
+            VkCommandBuffer secondary;
+            VK_CHECK(vkAllocateCommandBuffers(vk_engine->_device,
+                                              &secondaryAllocInfo, &secondary));
+            _frame._workerCommandBuffers.push_back(secondary);
+        }
     }
 
     VkCommandPool immCommandPool;
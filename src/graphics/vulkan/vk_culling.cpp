@@ -0,0 +1,144 @@
+#include "graphics/vulkan/vk_culling.h"
+
+#include <glm/geometric.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VK_CULLING_SSE
+#include <emmintrin.h>
+#endif
+
+void CullSpheres::clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    count = 0;
+}
+
+void CullSpheres::push(const glm::vec4& sphere) {
+    // keep the padding lanes after the last sphere, overwrite them first
+    if (count < x.size()) {
+        x[count] = sphere.x;
+        y[count] = sphere.y;
+        z[count] = sphere.z;
+        radius[count] = sphere.w;
+    } else {
+        for (uint32_t i = 0; i < 4; i++) {
+            x.push_back(i == 0 ? sphere.x : 0.f);
+            y.push_back(i == 0 ? sphere.y : 0.f);
+            z.push_back(i == 0 ? sphere.z : 0.f);
+            radius.push_back(i == 0 ? sphere.w : 0.f);
+        }
+    }
+    count++;
+}
+
+Frustum vkutil::extract_frustum(const glm::mat4& viewproj) {
+    // glm is column major, row i of the matrix is m[0][i] .. m[3][i]
+    auto row = [&](int i) {
+        return glm::vec4(viewproj[0][i], viewproj[1][i], viewproj[2][i],
+                         viewproj[3][i]);
+    };
+
+    Frustum frustum{};
+    frustum.planes[0] = row(3) + row(0);  // left
+    frustum.planes[1] = row(3) - row(0);  // right
+    frustum.planes[2] = row(3) + row(1);  // bottom
+    frustum.planes[3] = row(3) - row(1);  // top
+    // 0..1 depth reversed, z = 0 is the far plane and z = w the near one
+    frustum.planes[4] = row(2);           // far
+    frustum.planes[5] = row(3) - row(2);  // near
+
+    for (glm::vec4& plane : frustum.planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return frustum;
+}
+
+void vkutil::cull_spheres(const Frustum& frustum,
+                          const ScreenSizeCull& screenSize,
+                          const CullSpheres& spheres,
+                          std::vector<uint8_t>& visible) {
+#ifdef VK_CULLING_SSE
+    visible.resize(spheres.x.size());
+
+    // small objects are dropped when radius < minRadiusOverDepth * depth
+    const bool sizeTest = screenSize.minRadiusOverDepth > 0.f;
+
+    __m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+    for (int p = 0; p < 6; p++) {
+        planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+        planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+        planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+        planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+    }
+    const __m128 depthX = _mm_set1_ps(screenSize.depthPlane.x);
+    const __m128 depthY = _mm_set1_ps(screenSize.depthPlane.y);
+    const __m128 depthZ = _mm_set1_ps(screenSize.depthPlane.z);
+    const __m128 depthW = _mm_set1_ps(screenSize.depthPlane.w);
+    const __m128 minRatio = _mm_set1_ps(screenSize.minRadiusOverDepth);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (size_t i = 0; i < spheres.x.size(); i += 4) {
+        const __m128 x = _mm_loadu_ps(&spheres.x[i]);
+        const __m128 y = _mm_loadu_ps(&spheres.y[i]);
+        const __m128 z = _mm_loadu_ps(&spheres.z[i]);
+        const __m128 radius = _mm_loadu_ps(&spheres.radius[i]);
+        const __m128 negRadius = _mm_sub_ps(zero, radius);
+
+        // a lane survives while its signed distance is >= -radius for
+        // every plane
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int p = 0; p < 6; p++) {
+            __m128 distance = _mm_mul_ps(x, planeX[p]);
+            distance = _mm_add_ps(distance, _mm_mul_ps(y, planeY[p]));
+            distance = _mm_add_ps(distance, _mm_mul_ps(z, planeZ[p]));
+            distance = _mm_add_ps(distance, planeW[p]);
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+        }
+
+        if (sizeTest) {
+            __m128 depth = _mm_mul_ps(x, depthX);
+            depth = _mm_add_ps(depth, _mm_mul_ps(y, depthY));
+            depth = _mm_add_ps(depth, _mm_mul_ps(z, depthZ));
+            depth = _mm_add_ps(depth, depthW);
+            inside = _mm_and_ps(
+                    inside, _mm_cmpge_ps(radius, _mm_mul_ps(minRatio, depth)));
+        }
+
+        const int mask = _mm_movemask_ps(inside);
+        visible[i + 0] = (mask >> 0) & 1;
+        visible[i + 1] = (mask >> 1) & 1;
+        visible[i + 2] = (mask >> 2) & 1;
+        visible[i + 3] = (mask >> 3) & 1;
+    }
+#else
+    cull_spheres_scalar(frustum, screenSize, spheres, visible);
+#endif
+}
+
+void vkutil::cull_spheres_scalar(const Frustum& frustum,
+                                 const ScreenSizeCull& screenSize,
+                                 const CullSpheres& spheres,
+                                 std::vector<uint8_t>& visible) {
+    visible.resize(spheres.x.size());
+    const bool sizeTest = screenSize.minRadiusOverDepth > 0.f;
+
+    for (size_t i = 0; i < spheres.x.size(); i++) {
+        const glm::vec3 center{spheres.x[i], spheres.y[i], spheres.z[i]};
+        const float radius = spheres.radius[i];
+
+        bool inside = true;
+        for (const glm::vec4& plane : frustum.planes) {
+            inside &= glm::dot(glm::vec3(plane), center) + plane.w >= -radius;
+        }
+        if (sizeTest) {
+            const float depth =
+                    glm::dot(glm::vec3(screenSize.depthPlane), center) +
+                    screenSize.depthPlane.w;
+            inside &= radius >= screenSize.minRadiusOverDepth * depth;
+        }
+        visible[i] = inside;
+    }
+}
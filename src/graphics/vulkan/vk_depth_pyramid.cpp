@@ -0,0 +1,198 @@
+#include "graphics/vulkan/vk_depth_pyramid.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#include "graphics/vulkan/vk_engine.h"
+#include "graphics/vulkan/vk_images.h"
+#include "graphics/vulkan/vk_initializers.h"
+
+namespace {
+constexpr uint32_t REDUCE_GROUP_SIZE = 32;
+
+uint32_t previous_pow2(uint32_t value) {
+    return std::bit_floor(std::max(value, 1u));
+}
+}  // namespace
+
+void DepthPyramid::init(VulkanEngine* vk_engine) {
+    _engine = vk_engine;
+    const VkDevice device = _engine->_device;
+
+    const VkExtent3D depthExtent = _engine->_depthImage->get().imageExtent;
+    _extent = {previous_pow2(depthExtent.width),
+               previous_pow2(depthExtent.height)};
+    _levelCount = std::bit_width(std::max(_extent.width, _extent.height));
+
+    VkImageCreateInfo imageInfo = vkinit::image_create_info(
+            VK_FORMAT_R32_SFLOAT,
+            VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_STORAGE_BIT,
+            {_extent.width, _extent.height, 1});
+    imageInfo.mipLevels = _levelCount;
+
+    VmaAllocationCreateInfo allocInfo{};
+    allocInfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
+    allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+
+    _image.imageFormat = VK_FORMAT_R32_SFLOAT;
+    _image.imageExtent = imageInfo.extent;
+    VK_CHECK(vmaCreateImage(_engine->_allocator, &imageInfo, &allocInfo,
+                            &_image.image, &_image.allocation, nullptr));
+
+    VkImageViewCreateInfo viewInfo = vkinit::imageview_create_info(
+            VK_FORMAT_R32_SFLOAT, _image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    viewInfo.subresourceRange.levelCount = _levelCount;
+    VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr, &_image.imageView));
+
+    _levelViews.resize(_levelCount);
+    for (uint32_t level = 0; level < _levelCount; level++) {
+        viewInfo.subresourceRange.baseMipLevel = level;
+        viewInfo.subresourceRange.levelCount = 1;
+        VK_CHECK(vkCreateImageView(device, &viewInfo, nullptr,
+                                   &_levelViews[level]));
+    }
+
+    // linear filtering with a min reduction returns the smallest of the
+    // 2x2 texels around the sample point
+    VkSamplerReductionModeCreateInfo reductionInfo{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO};
+    reductionInfo.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+
+    VkSamplerCreateInfo samplerInfo{
+            .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    samplerInfo.pNext = &reductionInfo;
+    samplerInfo.magFilter = VK_FILTER_LINEAR;
+    samplerInfo.minFilter = VK_FILTER_LINEAR;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.minLod = 0.f;
+    samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+    VK_CHECK(vkCreateSampler(device, &samplerInfo, nullptr,
+                             &_reductionSampler));
+
+    {
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        _reduceLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    {
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        _sampleLayout = builder.build(device, VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+
+    std::array<DescriptorAllocator::PoolSizeRatio, 2> sizes{{
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+    }};
+    _descriptorAllocator.init_pool(device, _levelCount + 1, sizes);
+
+    DescriptorWriter writer;
+    _reduceSets.resize(_levelCount);
+    for (uint32_t level = 0; level < _levelCount; level++) {
+        _reduceSets[level] = _descriptorAllocator.allocate(device, _reduceLayout);
+
+        writer.clear();
+        writer.write_image(0, _levelViews[level], VK_NULL_HANDLE,
+                           VK_IMAGE_LAYOUT_GENERAL,
+                           VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        if (level == 0) {
+            writer.write_image(1, _engine->_depthImage->imageView(),
+                               _reductionSampler,
+                               VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        } else {
+            writer.write_image(1, _levelViews[level - 1], _reductionSampler,
+                               VK_IMAGE_LAYOUT_GENERAL,
+                               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        writer.update_set(device, _reduceSets[level]);
+    }
+
+    _sampleSet = _descriptorAllocator.allocate(device, _sampleLayout);
+    writer.clear();
+    writer.write_image(0, _image.imageView, _reductionSampler,
+                       VK_IMAGE_LAYOUT_GENERAL,
+                       VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.update_set(device, _sampleSet);
+
+    ComputePipeline::ComputePipelineConfig reduceConfig;
+    reduceConfig.descriptorSetLayout = _reduceLayout;
+    reduceConfig.shaderPath = "./shaders/depth_reduce.comp.spv";
+    reduceConfig.pushConstants.push_back(
+            {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::vec2)});
+    _reducePipeline = std::make_unique<ComputePipeline>(reduceConfig);
+    _reducePipeline->init(device);
+
+    // the cull pass may sample the pyramid before it is first built
+    _engine->command_buffers.immediate_submit(
+            [&](VkCommandBuffer cmd) {
+                vkutil::transition_image(cmd, _image.image,
+                                         VK_IMAGE_LAYOUT_UNDEFINED,
+                                         VK_IMAGE_LAYOUT_GENERAL);
+            },
+            _engine);
+}
+
+void DepthPyramid::cleanup() {
+    if (_image.image == VK_NULL_HANDLE) {
+        return;
+    }
+    const VkDevice device = _engine->_device;
+
+    _reducePipeline->destroy();
+    _descriptorAllocator.destroy_pool(device);
+    vkDestroyDescriptorSetLayout(device, _reduceLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, _sampleLayout, nullptr);
+    vkDestroySampler(device, _reductionSampler, nullptr);
+
+    for (const VkImageView view : _levelViews) {
+        vkDestroyImageView(device, view, nullptr);
+    }
+    _levelViews.clear();
+    vkDestroyImageView(device, _image.imageView, nullptr);
+    vmaDestroyImage(_engine->_allocator, _image.image, _image.allocation);
+    _image = {};
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd) {
+    const VkImage depthImage = _engine->_depthImage->get().image;
+    vkutil::transition_image(cmd, depthImage,
+                             VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
+                             VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+
+    _reducePipeline->bind(cmd);
+
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers = &barrier;
+
+    for (uint32_t level = 0; level < _levelCount; level++) {
+        const uint32_t width = std::max(_extent.width >> level, 1u);
+        const uint32_t height = std::max(_extent.height >> level, 1u);
+        const glm::vec2 levelSize{width, height};
+
+        _reducePipeline->bindDescriptorSets(cmd, &_reduceSets[level], 1);
+        _reducePipeline->pushConstants(cmd, 0, sizeof(levelSize), &levelSize);
+        _reducePipeline->dispatch(
+                cmd, (width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                (height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE);
+
+        // the next level samples this one
+        vkCmdPipelineBarrier2(cmd, &dependency);
+    }
+
+    vkutil::transition_image(cmd, depthImage,
+                             VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                             VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+}
@@ -3,10 +3,11 @@
 #include "graphics/vulkan/vk_types.h"
 
 void DescriptorLayoutBuilder::add_binding(uint32_t binding,
-                                          VkDescriptorType type) {
+                                          VkDescriptorType type,
+                                          uint32_t count) {
     VkDescriptorSetLayoutBinding newbind{};
     newbind.binding = binding;
-    newbind.descriptorCount = 1;
+    newbind.descriptorCount = count;
     newbind.descriptorType = type;
 
     bindings.push_back(newbind);
@@ -6,12 +6,15 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
 #include <cstring>
 #include <filesystem>
 #include <fmt/base.h>
+#include <functional>
+#include <numeric>
 #include <optional>
-#include <random>
 #include <system_error>
 
 #include "core/Logging.h"
@@ -33,9 +36,12 @@
 #include "graphics/vulkan/vk_images.h"
 #include "graphics/vulkan/vk_initializers.h"
 #include "graphics/vulkan/vk_loader.h"
+#include "graphics/vulkan/vk_mesh_optimizer.h"
 #include "graphics/vulkan/vk_pipelines.h"
 #include "graphics/vulkan/vk_types.h"
+#include "graphics/vulkan/vk_vertex_packing.h"
 #include "graphics/vulkan/vk_command_buffers.h"
+#include "graphics/vulkan/vk_culling.h"
 
 VulkanEngine* loadedEngine = nullptr;
 
@@ -49,6 +55,10 @@ constexpr bool bUseValidationLayers = false;
 constexpr bool bUseValidationLayers = true;
 #endif
 
+// camera clip planes, the projection maps them to depth 1 and 0
+constexpr float CAMERA_NEAR = 0.1f;
+constexpr float CAMERA_FAR = 10000.f;
+
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanEngine::debugCallback(
         VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
         VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -122,19 +132,8 @@ void VulkanEngine::init_default_data() {
 
     // 3 default textures, white, grey, black. 1 pixel each
     const uint32_t white = glm::packUnorm4x8(glm::vec4(1, 1, 1, 1));
-    AllocatedImage whiteImageData = create_image(&white, VkExtent3D{1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM,
-                         VK_IMAGE_USAGE_SAMPLED_BIT);
-    _whiteImage = std::make_unique<VulkanImage>(_allocator, _device, whiteImageData);
-
     const uint32_t grey = glm::packUnorm4x8(glm::vec4(0.66f, 0.66f, 0.66f, 1));
-    AllocatedImage greyImageData = create_image(&grey, VkExtent3D{1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM,
-                         VK_IMAGE_USAGE_SAMPLED_BIT);
-    _greyImage = std::make_unique<VulkanImage>(_allocator, _device, greyImageData);
-
     const uint32_t black = glm::packUnorm4x8(glm::vec4(0, 0, 0, 0));
-    AllocatedImage blackImageData = create_image(&black, VkExtent3D{1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM,
-                         VK_IMAGE_USAGE_SAMPLED_BIT);
-    _blackImage = std::make_unique<VulkanImage>(_allocator, _device, blackImageData);
 
     // checkerboard image
     const uint32_t magenta = glm::packUnorm4x8(glm::vec4(1, 0, 1, 1));
@@ -144,9 +143,19 @@ void VulkanEngine::init_default_data() {
             pixels[y * 16 + x] = ((x % 2) ^ (y % 2)) ? magenta : black;
         }
     }
-    AllocatedImage errorImageData = create_image(pixels.data(), VkExtent3D{16, 16, 1},
-                         VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT);
-    _errorCheckerboardImage = std::make_unique<VulkanImage>(_allocator, _device, errorImageData);
+
+    // one upload for all of them
+    const std::array<ImageData, 4> defaultImages{{
+            {&white, {1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT},
+            {&grey, {1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT},
+            {&black, {1, 1, 1}, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT},
+            {pixels.data(), {16, 16, 1}, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT},
+    }};
+    const std::vector<AllocatedImage> defaultImageData = create_images(defaultImages);
+    _whiteImage = std::make_unique<VulkanImage>(_allocator, _device, defaultImageData[0]);
+    _greyImage = std::make_unique<VulkanImage>(_allocator, _device, defaultImageData[1]);
+    _blackImage = std::make_unique<VulkanImage>(_allocator, _device, defaultImageData[2]);
+    _errorCheckerboardImage = std::make_unique<VulkanImage>(_allocator, _device, defaultImageData[3]);
 
     VkSamplerCreateInfo sampl = {.sType =
                                          VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
@@ -166,28 +175,11 @@ void VulkanEngine::init_default_data() {
     materialResources.colorSampler = _defaultSamplerLinear;
     materialResources.metalRoughImage = _whiteImage->get();
     materialResources.metalRoughSampler = _defaultSamplerLinear;
-
-    // set the uniform buffer for the material data
-    const AllocatedBuffer materialConstants = create_buffer(
-            sizeof(GLTFMetallic_Roughness::MaterialConstants),
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    // write the buffer
-    auto* sceneUniformData =
-            (GLTFMetallic_Roughness::MaterialConstants*)
-                    materialConstants.allocation->GetMappedData();
-    sceneUniformData->colorFactors = glm::vec4{1, 1, 1, 1};
-    sceneUniformData->metal_rough_factors = glm::vec4{1, 0.5, 0, 0};
-
-    // Store material constants buffer in managed buffers for automatic cleanup
-    _managedBuffers.push_back(std::make_unique<VulkanBuffer>(_allocator, materialConstants));
-
-    materialResources.dataBuffer = materialConstants.buffer;
-    materialResources.dataBufferOffset = 0;
+    materialResources.constants.colorFactors = glm::vec4{1, 1, 1, 1};
+    materialResources.constants.metal_rough_factors = glm::vec4{1, 0.5, 0, 0};
 
     defaultData = metalRoughMaterial.write_material(
-            _device, MaterialPass::MainColor, materialResources,
-            globalDescriptorAllocator);
+            MaterialPass::MainColor, materialResources, bindless_table);
 }
 
 void VulkanEngine::init_imgui() {
@@ -258,7 +250,9 @@ void VulkanEngine::init_descriptors() {
     // create a descriptor pool that will hold 10 sets with 1 image each
     std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
             {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}};
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2}};
 
     globalDescriptorAllocator.init(_device, 10, sizes);
 
@@ -272,10 +266,15 @@ void VulkanEngine::init_descriptors() {
 
     {
         DescriptorLayoutBuilder builder;
-        builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        _gpuSceneDataDescriptorLayout =
-                builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT |
-                                               VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+        VkShaderStageFlags stages =
+                VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+        // the meshlet pipelines cull and project in these stages
+        if (_meshShaderSupported) {
+            stages |= VK_SHADER_STAGE_TASK_BIT_EXT |
+                      VK_SHADER_STAGE_MESH_BIT_EXT;
+        }
+        _gpuSceneDataDescriptorLayout = builder.build(_device, stages);
     }
 
     {
@@ -296,43 +295,80 @@ void VulkanEngine::init_descriptors() {
 
     writer.update_set(_device, _drawImageDescriptors);
 
-    for (auto& _frame : _frames) {
-        // create a descriptor pool
-        std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> frame_sizes = {
-                {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
-                {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
-                {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
-                {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4},
-        };
+    write_scene_data_descriptors();
+
+    bindless_table.init(this);
+    asset_cache.init(this);
+    depth_pyramid.init(this);
+}
 
-        _frame._frameDescriptors = DescriptorAllocatorGrowable{};
-        _frame._frameDescriptors.init(_device, 1000, frame_sizes);
+void VulkanEngine::write_scene_data_descriptors() {
+    // one set covers every frame until the ring grows. Frames in flight may
+    // still bind the previous set, so it is retired and a set retired long
+    // enough ago is rewritten instead, so the pool stays at a few sets
+    const auto reusable = std::ranges::find_if(
+            _retiredSceneDataDescriptors, [&](const RetiredSet& retired) {
+                return retired.frame + _framesInFlight <= _frameNumber;
+            });
+    VkDescriptorSet set;
+    if (reusable != _retiredSceneDataDescriptors.end()) {
+        set = reusable->set;
+        _retiredSceneDataDescriptors.erase(reusable);
+    } else {
+        set = globalDescriptorAllocator.allocate(
+                _device, _gpuSceneDataDescriptorLayout);
+    }
 
-        // No need for deletion queue - frame descriptors will be cleaned up in cleanup()
+    if (_sceneDataDescriptors != VK_NULL_HANDLE) {
+        _retiredSceneDataDescriptors.push_back(
+                {_sceneDataDescriptors, _frameNumber});
     }
+    _sceneDataDescriptors = set;
+
+    DescriptorWriter writer;
+    writer.write_buffer(0, frame_ring.buffer(), sizeof(GPUSceneData), 0,
+                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    writer.update_set(_device, _sceneDataDescriptors);
 }
 
 void VulkanEngine::init_pipelines() {
-    pipelines.init(_device, _singleImageDescriptorLayout, _drawImageDescriptorLayout, _drawImage->get());
+    pipelines.init(_device, _singleImageDescriptorLayout, _drawImageDescriptorLayout,
+                   depth_pyramid.sample_layout(), _drawImage->get());
     // Pipeline cleanup is handled automatically by the Pipelines object
     metalRoughMaterial.build_pipelines(this);
 }
 
-void VulkanEngine::init(SDL_Window* window) {
+void VulkanEngine::init(SDL_Window* window, const EngineConfig& config) {
     _window = window;
+    _config = config;
+
+    if (_config.headless) {
+        _windowExtent = _config.headlessExtent;
+    }
+
+    _framesInFlight = std::clamp(_config.framesInFlight, 1u,
+                                 MAX_FRAMES_IN_FLIGHT);
 
     // only one engine initialization is allowed with the application.
     assert(loadedEngine == nullptr);
+    assert(_window != nullptr || _config.headless);
     loadedEngine = this;
     init_vulkan();
     init_swapchain();
-    
+
+    _workerPool = std::make_unique<ThreadPool>(_config.recordThreads);
+    LOGI("Recording draws on {} worker threads", _workerPool->size());
+
     command_buffers.init_commands(this);
     
     init_sync_structures();
     init_descriptors();
     init_pipelines();
-    init_imgui();
+    // imgui needs a window to attach to, there is nothing to show it on
+    // in headless mode
+    if (!_config.headless) {
+        init_imgui();
+    }
     init_default_data();
 
     mainCamera->velocity = glm::vec3(0.f);
@@ -379,6 +415,7 @@ void VulkanEngine::init_vulkan() {
                             .request_validation_layers(bUseValidationLayers)
                             .set_debug_callback(debugCallback)
                             .require_api_version(1, 3, 0)
+                            .set_headless(_config.headless)
                             .build();
 
     if (!inst_ret) {
@@ -392,9 +429,12 @@ void VulkanEngine::init_vulkan() {
     _instance = vkb_inst.instance;
     _debug_messenger = vkb_inst.debug_messenger;
 
-    SDL_bool err = SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
-    if (!err) {
-        LOGE("Failed to create Vulkan surface. Error: {}", SDL_GetError());
+    if (!_config.headless) {
+        SDL_bool err =
+                SDL_Vulkan_CreateSurface(_window, _instance, &_surface);
+        if (!err) {
+            LOGE("Failed to create Vulkan surface. Error: {}", SDL_GetError());
+        }
     }
 
     // vulkan 1.3 features
@@ -406,26 +446,72 @@ void VulkanEngine::init_vulkan() {
     VkPhysicalDeviceVulkan12Features features12{};
     features12.bufferDeviceAddress = true;
     features12.descriptorIndexing = true;
+    features12.timelineSemaphore = true;
+    // bindless table
+    features12.runtimeDescriptorArray = true;
+    features12.descriptorBindingPartiallyBound = true;
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingStorageBufferUpdateAfterBind = true;
+    features12.descriptorBindingUpdateUnusedWhilePending = true;
+    features12.shaderSampledImageArrayNonUniformIndexing = true;
+    // indirect draw path
+    features12.drawIndirectCount = true;
+    // depth pyramid reduction
+    features12.samplerFilterMinmax = true;
+
+    // vulkan 1.0 features
+    VkPhysicalDeviceFeatures features10{};
+    features10.multiDrawIndirect = true;
+    features10.drawIndirectFirstInstance = true;
 
     // use vkbootstrap to select a gpu.
     // We want a gpu that can write to the SDL surface and supports vulkan 1.3
-    // with the correct features
+    // with the correct features. A headless instance has no surface, so any
+    // device with the features will do, including software ones like lavapipe
     vkb::PhysicalDeviceSelector selector{vkb_inst};
+    selector.set_minimum_version(1, 3)
+            .set_required_features_13(features)
+            .set_required_features_12(features12)
+            .set_required_features(features10);
+
+    if (!_config.headless) {
+        selector.set_surface(_surface);
+    }
 
-    auto physical_device_ret = selector.set_minimum_version(1, 3)
-                                       .set_required_features_13(features)
-                                       .set_required_features_12(features12)
-                                       .set_surface(_surface)
-                                       .select();
+    auto physical_device_ret = selector.select();
 
     if (!physical_device_ret) {
         LOGE("Failed to select physical device. Error: {}",
              physical_device_ret.error().message());
     }
 
-    const vkb::PhysicalDevice& physicalDevice = physical_device_ret.value();
+    vkb::PhysicalDevice physicalDevice = physical_device_ret.value();
+    LOGI("Selected GPU: {}", physicalDevice.name);
+
+    // optional meshlet path, the renderer falls back to vertex pulling
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{
+            .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT};
+    if (physicalDevice.enable_extension_if_present(
+                VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features2{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                .pNext = &meshShaderFeatures};
+        vkGetPhysicalDeviceFeatures2(physicalDevice.physical_device,
+                                     &features2);
+        _meshShaderSupported =
+                meshShaderFeatures.taskShader && meshShaderFeatures.meshShader;
+    }
+    LOGI("Mesh shaders: {}", _meshShaderSupported ? "yes" : "no");
 
     vkb::DeviceBuilder deviceBuilder{physicalDevice};
+    if (_meshShaderSupported) {
+        // only the stages, not the multiview or shading rate extras
+        meshShaderFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+                .taskShader = VK_TRUE,
+                .meshShader = VK_TRUE};
+        deviceBuilder.add_pNext(&meshShaderFeatures);
+    }
 
     auto dev_ret = deviceBuilder.build();
     if (!dev_ret) {
@@ -439,6 +525,21 @@ void VulkanEngine::init_vulkan() {
     _device = vkbDevice.device;
     _chosenGPU = physicalDevice.physical_device;
 
+    if (_meshShaderSupported) {
+        _vkCmdDrawMeshTasksEXT = reinterpret_cast<PFN_vkCmdDrawMeshTasksEXT>(
+                vkGetDeviceProcAddr(_device, "vkCmdDrawMeshTasksEXT"));
+
+        VkPhysicalDeviceMeshShaderPropertiesEXT meshProperties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_PROPERTIES_EXT};
+        VkPhysicalDeviceProperties2 properties{
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+        properties.pNext = &meshProperties;
+        vkGetPhysicalDeviceProperties2(_chosenGPU, &properties);
+        _maxTaskGroupCountX = meshProperties.maxTaskWorkGroupCount[0];
+        _maxTaskGroupCountY = meshProperties.maxTaskWorkGroupCount[1];
+        _maxTaskGroupTotal = meshProperties.maxTaskWorkGroupTotalCount;
+    }
+
     auto queue_ret = vkbDevice.get_queue(vkb::QueueType::graphics);
     if (!queue_ret) {
         LOGE("Failed to retrieve graphics queue. Error: {}",
@@ -455,6 +556,37 @@ void VulkanEngine::init_vulkan() {
 
     _graphicsQueueFamily = queue_family_ret.value();
 
+    // prefer a transfer-only family (usually the DMA engine), then any family
+    // other than graphics, then share the graphics queue
+    VkQueue transferQueue = _graphicsQueue;
+    uint32_t transferQueueFamily = _graphicsQueueFamily;
+    if (auto dedicated = vkbDevice.get_dedicated_queue(vkb::QueueType::transfer)) {
+        transferQueue = dedicated.value();
+        transferQueueFamily =
+                vkbDevice.get_dedicated_queue_index(vkb::QueueType::transfer)
+                        .value();
+    } else if (auto separate = vkbDevice.get_queue(vkb::QueueType::transfer)) {
+        transferQueue = separate.value();
+        transferQueueFamily =
+                vkbDevice.get_queue_index(vkb::QueueType::transfer).value();
+    }
+    LOGI("Uploading on queue family {} (graphics family {})",
+         transferQueueFamily, _graphicsQueueFamily);
+
+    _computeQueue = _graphicsQueue;
+    _computeQueueFamily = _graphicsQueueFamily;
+    if (auto dedicated = vkbDevice.get_dedicated_queue(vkb::QueueType::compute)) {
+        _computeQueue = dedicated.value();
+        _computeQueueFamily =
+                vkbDevice.get_dedicated_queue_index(vkb::QueueType::compute)
+                        .value();
+    } else if (auto separate = vkbDevice.get_queue(vkb::QueueType::compute)) {
+        _computeQueue = separate.value();
+        _computeQueueFamily =
+                vkbDevice.get_queue_index(vkb::QueueType::compute).value();
+    }
+    LOGI("Async compute on queue family {}", _computeQueueFamily);
+
     // initialize the memory allocator
     VmaAllocatorCreateInfo allocatorInfo = {};
     allocatorInfo.physicalDevice = _chosenGPU;
@@ -463,6 +595,13 @@ void VulkanEngine::init_vulkan() {
     allocatorInfo.flags = VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
     vmaCreateAllocator(&allocatorInfo, &_allocator);
 
+    transfer_queue.init(this, transferQueue, transferQueueFamily);
+
+    frame_ring.init(this, _config.frameRingBytes, MAX_FRAMES_IN_FLIGHT);
+
+    geometry_buffer.init(this, _config.geometryVertexBytes,
+                         _config.geometryIndexCount);
+
     // VMA allocator will be destroyed in cleanup() - no need for deletion queue
 }
 
@@ -473,26 +612,88 @@ void VulkanEngine::init_sync_structures() {
             vkinit::semaphore_create_info();
 
     for (auto& _frame : _frames) {
-        VkFence renderFence;
-        VK_CHECK(vkCreateFence(_device, &fenceCreateInfo, nullptr, &renderFence));
-        _frame._renderFence = std::make_unique<VulkanFence>(_device, renderFence);
-
-        VkSemaphore swapchainSemaphore, renderSemaphore;
+        VkSemaphore swapchainSemaphore;
         VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &swapchainSemaphore));
-        VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr, &renderSemaphore));
-        
+
         _frame._swapchainSemaphore = std::make_unique<VulkanSemaphore>(_device, swapchainSemaphore);
-        _frame._renderSemaphore = std::make_unique<VulkanSemaphore>(_device, renderSemaphore);
     }
 
+    VkSemaphoreTypeCreateInfo timelineInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo timelineCreateInfo = vkinit::semaphore_create_info();
+    timelineCreateInfo.pNext = &timelineInfo;
+
+    VkSemaphore frameTimeline;
+    VK_CHECK(vkCreateSemaphore(_device, &timelineCreateInfo, nullptr,
+                               &frameTimeline));
+    _frameTimeline = std::make_unique<VulkanSemaphore>(_device, frameTimeline);
+
+    VkSemaphore computeTimeline;
+    VK_CHECK(vkCreateSemaphore(_device, &timelineCreateInfo, nullptr,
+                               &computeTimeline));
+    _computeTimeline =
+            std::make_unique<VulkanSemaphore>(_device, computeTimeline);
+
     VkFence immFence;
     VK_CHECK(vkCreateFence(_device, &fenceCreateInfo, nullptr, &immFence));
     _immFence = std::make_unique<VulkanFence>(_device, immFence);
 }
 
+VkPresentModeKHR VulkanEngine::choose_present_mode(
+        VkPresentModeKHR desired) const {
+    uint32_t modeCount = 0;
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(_chosenGPU, _surface,
+                                                       &modeCount, nullptr));
+    std::vector<VkPresentModeKHR> supported(modeCount);
+    VK_CHECK(vkGetPhysicalDeviceSurfacePresentModesKHR(
+            _chosenGPU, _surface, &modeCount, supported.data()));
+
+    // both non-vsync modes are better than FIFO if the other one is missing
+    std::vector<VkPresentModeKHR> candidates;
+    switch (desired) {
+        case VK_PRESENT_MODE_MAILBOX_KHR:
+            candidates = {VK_PRESENT_MODE_MAILBOX_KHR,
+                          VK_PRESENT_MODE_IMMEDIATE_KHR};
+            break;
+        case VK_PRESENT_MODE_IMMEDIATE_KHR:
+            candidates = {VK_PRESENT_MODE_IMMEDIATE_KHR,
+                          VK_PRESENT_MODE_MAILBOX_KHR};
+            break;
+        case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+            candidates = {VK_PRESENT_MODE_FIFO_RELAXED_KHR};
+            break;
+        default:
+            break;
+    }
+
+    for (const VkPresentModeKHR mode : candidates) {
+        if (std::find(supported.begin(), supported.end(), mode) !=
+            supported.end()) {
+            if (mode != desired) {
+                LOGW("Present mode {} is not supported, using {}",
+                     static_cast<int>(desired), static_cast<int>(mode));
+            }
+            return mode;
+        }
+    }
+
+    if (desired != VK_PRESENT_MODE_FIFO_KHR) {
+        LOGW("Present mode {} is not supported, using FIFO",
+             static_cast<int>(desired));
+    }
+
+    // the only mode the spec guarantees
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
 void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
     vkb::SwapchainBuilder swapchainBuilder{_chosenGPU, _device, _surface};
 
+    _presentMode = choose_present_mode(_config.presentMode);
+
     _swapchainImageFormat = VK_FORMAT_B8G8R8A8_UNORM;
 
     auto swap_ret =
@@ -501,8 +702,7 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
                     .set_desired_format(VkSurfaceFormatKHR{
                             .format = _swapchainImageFormat,
                             .colorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR})
-                    // use vsync present mode
-                    .set_desired_present_mode(VK_PRESENT_MODE_FIFO_KHR)
+                    .set_desired_present_mode(_presentMode)
                     .set_desired_extent(width, height)
                     .add_image_usage_flags(VK_IMAGE_USAGE_TRANSFER_DST_BIT)
                     .build();
@@ -519,10 +719,25 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height) {
     _swapchain = vkbSwapchain.swapchain;
     _swapchainImages = vkbSwapchain.get_images().value();
     _swapchainImageViews = vkbSwapchain.get_image_views().value();
+
+    const VkSemaphoreCreateInfo semaphoreCreateInfo =
+            vkinit::semaphore_create_info();
+    for (size_t i = 0; i < _swapchainImages.size(); i++) {
+        VkSemaphore renderSemaphore;
+        VK_CHECK(vkCreateSemaphore(_device, &semaphoreCreateInfo, nullptr,
+                                   &renderSemaphore));
+        _renderSemaphores.push_back(
+                std::make_unique<VulkanSemaphore>(_device, renderSemaphore));
+    }
 }
 
 void VulkanEngine::init_swapchain() {
-    create_swapchain(_windowExtent.width, _windowExtent.height);
+    if (_config.headless) {
+        // there is nothing to present to, the frame ends in the draw image
+        _swapchainExtent = _windowExtent;
+    } else {
+        create_swapchain(_windowExtent.width, _windowExtent.height);
+    }
 
     // draw image size will match the window
     const VkExtent3D drawImageExtent = {_windowExtent.width,
@@ -537,9 +752,20 @@ void VulkanEngine::init_swapchain() {
     drawImageUsages |= VK_IMAGE_USAGE_STORAGE_BIT;
     drawImageUsages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
 
-    const VkImageCreateInfo rimg_info = vkinit::image_create_info(
+    VkImageCreateInfo rimg_info = vkinit::image_create_info(
             drawImageFormat, drawImageUsages, drawImageExtent);
 
+    // the background pass may write the draw image from the async compute
+    // queue, share it instead of transferring ownership every frame
+    const std::array<uint32_t, 2> drawImageFamilies{_graphicsQueueFamily,
+                                                    _computeQueueFamily};
+    if (_computeQueueFamily != _graphicsQueueFamily) {
+        rimg_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        rimg_info.queueFamilyIndexCount =
+                static_cast<uint32_t>(drawImageFamilies.size());
+        rimg_info.pQueueFamilyIndices = drawImageFamilies.data();
+    }
+
     // for the draw image, we want to allocate it from gpu local memory
     VmaAllocationCreateInfo rimg_allocinfo = {};
     rimg_allocinfo.usage = VMA_MEMORY_USAGE_GPU_ONLY;
@@ -576,7 +802,8 @@ void VulkanEngine::init_swapchain() {
 
     VkImageCreateInfo dimg_info = vkinit::image_create_info(
         depthFormat, 
-        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, 
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_SAMPLED_BIT,
         depthImageExtent);
 
     VmaAllocationCreateInfo dimg_allocinfo = {};
@@ -610,6 +837,8 @@ void VulkanEngine::destroy_swapchain() {
     for (const auto& _swapchainImageView : _swapchainImageViews) {
         vkDestroyImageView(_device, _swapchainImageView, nullptr);
     }
+
+    _renderSemaphores.clear();
 }
 
 void VulkanEngine::cleanup() {
@@ -617,6 +846,26 @@ void VulkanEngine::cleanup() {
         // make sure the gpu has stopped doing its things
         vkDeviceWaitIdle(_device);
 
+        _workerPool.reset();
+
+        transfer_queue.cleanup();
+        frame_ring.cleanup();
+        for (const RetiredBuffer& retired : _retiredBuffers) {
+            destroy_buffer(retired.buffer);
+        }
+        _retiredBuffers.clear();
+
+        // scenes free their materials into the bindless table
+        mesh_slots.clear();
+        meshes.clear();
+        transforms.clear();
+        asset_cache.cleanup();
+        // meshes still alive only return their ranges to the allocators
+        geometry_buffer.cleanup();
+        bindless_table.cleanup();
+        depth_pyramid.cleanup();
+        destroy_buffer(_drawVisibility);
+
         loadedScenes.clear();
 
         // Smart pointers will automatically clean up resources
@@ -628,13 +877,18 @@ void VulkanEngine::cleanup() {
                 vkDestroyCommandPool(_device, _frame._commandPool->get(), nullptr);
             }
             
-            // Destroy frame descriptors manually
-            _frame._frameDescriptors.destroy_pools(_device);
+            _frame._workerCommandPools.clear();
+            _frame._computeCommandPool.reset();
+        }
+
+        if (!_config.headless) {
+            destroy_swapchain();
+            vkDestroySurfaceKHR(_instance, _surface, nullptr);
         }
 
-        destroy_swapchain();
+        _frameTimeline.reset();
+        _computeTimeline.reset();
 
-        vkDestroySurfaceKHR(_instance, _surface, nullptr);
         vkDestroyDevice(_device, nullptr);
 
         vkb::destroy_debug_utils_messenger(_instance, _debug_messenger);
@@ -676,33 +930,189 @@ void VulkanEngine::destroy_buffer(const AllocatedBuffer& buffer) const {
     vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
 }
 
-GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
-                                        std::span<Vertex> vertices) {
-    const size_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-    const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+AllocatedBuffer VulkanEngine::create_shared_buffer(
+        size_t allocSize, VkBufferUsageFlags usage,
+        VmaMemoryUsage memoryUsage) const {
+    if (!transfer_queue.is_dedicated()) {
+        return create_buffer(allocSize, usage, memoryUsage);
+    }
 
-    GPUMeshBuffers newSurface{};
+    const std::array<uint32_t, 2> queueFamilies{
+            _graphicsQueueFamily, transfer_queue.queue_family()};
+
+    VkBufferCreateInfo bufferInfo = {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    bufferInfo.size = allocSize;
+    bufferInfo.usage = usage;
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount =
+            static_cast<uint32_t>(queueFamilies.size());
+    bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+
+    VmaAllocationCreateInfo vmallocinfo = {};
+    vmallocinfo.usage = memoryUsage;
+    vmallocinfo.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    AllocatedBuffer newBuffer{};
+
+    VK_CHECK(vmaCreateBuffer(_allocator, &bufferInfo, &vmallocinfo,
+                             &newBuffer.buffer, &newBuffer.allocation,
+                             &newBuffer.info));
+
+    return newBuffer;
+}
+
+void VulkanEngine::retire_buffer(const AllocatedBuffer& buffer) {
+    // frames already submitted, and the one being recorded, may still read it
+    _retiredBuffers.push_back({buffer, _frameNumber});
+}
+
+void VulkanEngine::collect_retired_buffers() {
+    // once the current slot is free, every frame up to _framesInFlight ago
+    // has finished on the GPU
+    std::erase_if(_retiredBuffers, [&](const RetiredBuffer& retired) {
+        if (retired.frame + _framesInFlight > _frameNumber) {
+            return false;
+        }
+        destroy_buffer(retired.buffer);
+        return true;
+    });
+}
+
+void VulkanEngine::destroy_mesh_buffers(const GPUMeshBuffers& meshBuffers) {
+    geometry_buffer.free(meshBuffers.geometry);
+
+    // upload_meshlets hands its buffer to the managed collection, the
+    // wrapper destroys it when erased
+    if (meshBuffers.meshletBuffer.buffer != VK_NULL_HANDLE) {
+        std::erase_if(_managedBuffers,
+                      [&](const std::unique_ptr<VulkanBuffer>& b) {
+                          return b->buffer() ==
+                                 meshBuffers.meshletBuffer.buffer;
+                      });
+    }
+}
+
+void VulkanEngine::compact_geometry() {
+    const std::vector<GeometryMove> moves = geometry_buffer.defragment();
+    if (moves.empty()) {
+        return;
+    }
 
-    // create vertex buffer
-    newSurface.vertexBuffer =
-            create_buffer(vertexBufferSize,
+    std::unordered_map<VkDeviceSize, const GeometryMove*> movesByOffset;
+    for (const GeometryMove& move : moves) {
+        movesByOffset[move.from.vertexOffset] = &move;
+    }
+
+    // surfaces store first indices into the shared index buffer, they
+    // shift with their mesh
+    const auto relocate = [&](MeshAsset& mesh) {
+        const auto it = movesByOffset.find(mesh.meshBuffers.geometry.vertexOffset);
+        if (it == movesByOffset.end()) {
+            return;
+        }
+        const GeometryMove& move = *it->second;
+        const auto shift = [&](uint32_t& startIndex) {
+            startIndex = startIndex - move.from.firstIndex + move.to.firstIndex;
+        };
+        for (GeoSurface& surface : mesh.surfaces) {
+            shift(surface.startIndex);
+            for (SurfaceLod& lod : surface.lods) {
+                shift(lod.startIndex);
+            }
+        }
+        mesh.meshBuffers.geometry = move.to;
+        movesByOffset.erase(it);
+    };
+
+    const auto relocateScene = [&](const LoadedGLTF& scene) {
+        for (const std::shared_ptr<MeshAsset>& mesh : scene.meshList) {
+            relocate(*mesh);
+        }
+    };
+    asset_cache.for_each_scene(relocateScene);
+    for (const auto& [name, scene] : loadedScenes) {
+        relocateScene(*scene);
+    }
+    for (const std::shared_ptr<MeshAsset>& mesh : testMeshes) {
+        relocate(*mesh);
+    }
+
+    LOGI("Compacted geometry buffers, moved {} meshes", moves.size());
+    if (!movesByOffset.empty()) {
+        LOGW("{} moved meshes have no owner", movesByOffset.size());
+    }
+}
+
+void VulkanEngine::upload_meshlets(const MeshletData& meshlets,
+                                   GPUMeshBuffers& meshBuffers) {
+    if (meshlets.meshlets.empty()) {
+        return;
+    }
+
+    // one buffer holds the three arrays, each at a 16 byte aligned offset
+    const auto align = [](size_t size) { return (size + 15) & ~size_t{15}; };
+    const size_t meshletSize = meshlets.meshlets.size() * sizeof(GPUMeshlet);
+    const size_t vertexSize = meshlets.vertices.size() * sizeof(uint32_t);
+    const size_t triangleSize = meshlets.triangles.size();
+    const size_t vertexOffset = align(meshletSize);
+    const size_t triangleOffset = vertexOffset + align(vertexSize);
+    const size_t bufferSize = triangleOffset + triangleSize;
+
+    meshBuffers.meshletBuffer =
+            create_buffer(bufferSize,
                           VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
                                   VK_BUFFER_USAGE_TRANSFER_DST_BIT |
                                   VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
                           VMA_MEMORY_USAGE_GPU_ONLY);
 
-    // find the address of the vertex buffer
     const VkBufferDeviceAddressInfo deviceAddressInfo{
             .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-            .buffer = newSurface.vertexBuffer.buffer};
-    newSurface.vertexBufferAddress =
+            .buffer = meshBuffers.meshletBuffer.buffer};
+    const VkDeviceAddress address =
             vkGetBufferDeviceAddress(_device, &deviceAddressInfo);
+    meshBuffers.meshlets = address;
+    meshBuffers.meshletVertices = address + vertexOffset;
+    meshBuffers.meshletTriangles = address + triangleOffset;
 
-    // create index buffer
-    newSurface.indexBuffer = create_buffer(
-            indexBufferSize,
-            VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-            VMA_MEMORY_USAGE_GPU_ONLY);
+    const AllocatedBuffer staging = create_buffer(
+            bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VMA_MEMORY_USAGE_CPU_ONLY);
+
+    char* data = static_cast<char*>(staging.allocation->GetMappedData());
+    memcpy(data, meshlets.meshlets.data(), meshletSize);
+    memcpy(data + vertexOffset, meshlets.vertices.data(), vertexSize);
+    memcpy(data + triangleOffset, meshlets.triangles.data(), triangleSize);
+
+    const std::array<BufferUpload, 1> uploads{{
+            {meshBuffers.meshletBuffer.buffer, 0, bufferSize,
+             VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT |
+                     VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT,
+             VK_ACCESS_2_SHADER_STORAGE_READ_BIT},
+    }};
+    transfer_queue.upload_buffers(staging, uploads);
+
+    _managedBuffers.push_back(std::make_unique<VulkanBuffer>(
+            _allocator, meshBuffers.meshletBuffer));
+}
+
+GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
+                                        std::span<Vertex> vertices,
+                                        UploadTicket* ticket) {
+    GPUMeshBuffers newSurface{};
+
+    std::vector<PackedVertex> packed;
+    std::span<const std::byte> vertexData = std::as_bytes(vertices);
+    if (_config.compactVertices) {
+        newSurface.positionDequant = vkutil::pack_vertices(vertices, packed);
+        vertexData = std::as_bytes(std::span(packed));
+    }
+
+    const size_t vertexBufferSize = vertexData.size();
+    const size_t indexBufferSize = indices.size() * sizeof(uint32_t);
+
+    // ranges of the shared buffers, may grow them
+    newSurface.geometry = geometry_buffer.allocate(
+            vertexBufferSize, static_cast<uint32_t>(indices.size()));
 
     const AllocatedBuffer staging = create_buffer(
             vertexBufferSize + indexBufferSize,
@@ -711,33 +1121,29 @@ GPUMeshBuffers VulkanEngine::uploadMesh(std::span<uint32_t> indices,
     void* data = staging.allocation->GetMappedData();
 
     // copy vertex buffer
-    memcpy(data, vertices.data(), vertexBufferSize);
+    memcpy(data, vertexData.data(), vertexBufferSize);
     // copy index buffer
     memcpy((char*)data + vertexBufferSize, indices.data(), indexBufferSize);
 
-    command_buffers.immediate_submit([&](VkCommandBuffer cmd) {
-        VkBufferCopy vertexCopy{0};
-        vertexCopy.dstOffset = 0;
-        vertexCopy.srcOffset = 0;
-        vertexCopy.size = vertexBufferSize;
-
-        vkCmdCopyBuffer(cmd, staging.buffer, newSurface.vertexBuffer.buffer, 1,
-                        &vertexCopy);
-
-        VkBufferCopy indexCopy{0};
-        indexCopy.dstOffset = 0;
-        indexCopy.srcOffset = vertexBufferSize;
-        indexCopy.size = indexBufferSize;
-
-        vkCmdCopyBuffer(cmd, staging.buffer, newSurface.indexBuffer.buffer, 1,
-                        &indexCopy);
-            },
-            this);
-
-    // Store mesh buffers in managed collections for automatic cleanup
-    _managedBuffers.push_back(std::make_unique<VulkanBuffer>(_allocator, newSurface.vertexBuffer));
-    _managedBuffers.push_back(std::make_unique<VulkanBuffer>(_allocator, newSurface.indexBuffer));
-    destroy_buffer(staging);
+    // the transfer queue frees the staging buffer once the copy is done
+    // the meshlet path pulls the same vertices in its mesh shader
+    VkPipelineStageFlags2 vertexStages = VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT;
+    if (_meshShaderSupported) {
+        vertexStages |= VK_PIPELINE_STAGE_2_MESH_SHADER_BIT_EXT;
+    }
+    const std::array<BufferUpload, 2> uploads{{
+            {geometry_buffer.vertex_buffer(), 0, vertexBufferSize,
+             vertexStages, VK_ACCESS_2_SHADER_STORAGE_READ_BIT,
+             newSurface.geometry.vertexOffset, true},
+            {geometry_buffer.index_buffer(), vertexBufferSize, indexBufferSize,
+             VK_PIPELINE_STAGE_2_INDEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT,
+             newSurface.geometry.firstIndex * sizeof(uint32_t), true},
+    }};
+    const UploadTicket uploadTicket =
+            transfer_queue.upload_buffers(staging, uploads);
+    if (ticket != nullptr) {
+        *ticket = uploadTicket;
+    }
 
     return newSurface;
 }
@@ -773,39 +1179,143 @@ void VulkanEngine::draw_imgui(VkCommandBuffer cmd,
 }
 
 void VulkanEngine::draw_geometry(VkCommandBuffer cmd) {
-    // allocate a new uniform buffer for the scene data
-    AllocatedBuffer gpuSceneDataBuffer = create_buffer(
-            sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-            VMA_MEMORY_USAGE_CPU_TO_GPU);
+    // write the scene data into this frame's slice of the ring buffer, the
+    // descriptor points at the ring and the slice is picked by dynamic offset
+    const RingAllocation sceneDataAllocation = frame_ring.push(sceneData);
+    const auto sceneDataOffset =
+            static_cast<uint32_t>(sceneDataAllocation.offset);
 
-    // add it to the current frame's managed buffers for automatic cleanup
-    get_current_frame()._frameBuffers.push_back(
-        std::make_unique<VulkanBuffer>(_allocator, gpuSceneDataBuffer));
+    // the set is persistent, nothing is allocated or written per frame
+    const VkDescriptorSet globalDescriptor = _sceneDataDescriptors;
 
-    // write the buffer
-    auto* sceneUniformData =
-            (GPUSceneData*)gpuSceneDataBuffer.allocation->GetMappedData();
-    *sceneUniformData = sceneData;
+    VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
+            _drawImage->imageView(), nullptr, VK_IMAGE_LAYOUT_GENERAL);
+    // cleared to 0, the far plane of the reversed depth projection. Every
+    // pass after the first loads it instead
+    VkRenderingAttachmentInfo depthAttachment = vkinit::depth_attachment_info(
+            _depthImage->imageView(), VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    VkRenderingInfo renderInfo = vkinit::rendering_info(
+            _drawExtent, &colorAttachment, &depthAttachment);
+
+    const std::span<const RenderObject> surfaces =
+            mainDrawContext.OpaqueSurfaces;
+
+    if (_config.indirectDraw) {
+        IndirectDrawList drawList = build_indirect_draws(surfaces);
+        stats.drawCount = static_cast<uint32_t>(drawList.batches.size());
+
+        // with the prepass the color pass only shades the nearest surface,
+        // its GREATER_OR_EQUAL test passes on the depth laid down before
+        const auto drawIndirect = [&] {
+            if (_config.depthPrepass) {
+                vkCmdBeginRendering(cmd, &renderInfo);
+                record_indirect_draws(cmd, globalDescriptor, sceneDataOffset,
+                                      drawList, true);
+                vkCmdEndRendering(cmd);
+                depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            }
+            vkCmdBeginRendering(cmd, &renderInfo);
+            record_indirect_draws(cmd, globalDescriptor, sceneDataOffset,
+                                  drawList, false);
+            vkCmdEndRendering(cmd);
+            depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+        };
 
-    // create a descriptor set that binds that buffer and update it
-    VkDescriptorSet globalDescriptor =
-            get_current_frame()._frameDescriptors.allocate(
-                    _device, _gpuSceneDataDescriptorLayout);
+        if (!_config.gpuCulling || !_config.occlusionCulling) {
+            if (_config.gpuCulling) {
+                cull_indirect_draws(cmd, drawList, CullPhase::Frustum);
+            }
+            drawIndirect();
+            return;
+        }
 
-    DescriptorWriter writer;
-    writer.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0,
-                        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.update_set(_device, globalDescriptor);
+        // draws visible last frame lay down depth first, the pyramid built
+        // from it then decides which of the other draws are needed
+        reserve_draw_visibility(cmd, static_cast<uint32_t>(surfaces.size()));
+        cull_indirect_draws(cmd, drawList, CullPhase::OcclusionEarly);
+        drawIndirect();
 
-    VkRenderingAttachmentInfo colorAttachment = vkinit::attachment_info(
-            _drawImage->imageView(), nullptr, VK_IMAGE_LAYOUT_GENERAL);
+        depth_pyramid.build(cmd);
+        cull_indirect_draws(cmd, drawList, CullPhase::OcclusionLate);
+        drawIndirect();
+        return;
+    }
 
-    VkRenderingInfo renderInfo =
-            vkinit::rendering_info(_drawExtent, &colorAttachment, nullptr);
-    vkCmdBeginRendering(cmd, &renderInfo);
+    const InstancedDrawList drawList = build_instanced_draws(surfaces);
+    const std::span<const InstancedDraw> draws = drawList.draws;
+    const VkDeviceAddress instances = drawList.instances.address;
+    stats.drawCount = static_cast<uint32_t>(draws.size());
+
+    if (_config.depthPrepass) {
+        vkCmdBeginRendering(cmd, &renderInfo);
+        record_draws(cmd, globalDescriptor, sceneDataOffset, draws, instances,
+                     true);
+        vkCmdEndRendering(cmd);
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
+
+    // below a few hundred draws per chunk the thread handoff costs more than
+    // the recording it saves
+    constexpr size_t MIN_DRAWS_PER_CHUNK = 256;
+    FrameData& frame = get_current_frame();
+    const auto chunkCount = static_cast<uint32_t>(
+            std::min(frame._workerCommandBuffers.size(),
+                     draws.size() / MIN_DRAWS_PER_CHUNK));
+
+    if (chunkCount <= 1) {
+        vkCmdBeginRendering(cmd, &renderInfo);
+        record_draws(cmd, globalDescriptor, sceneDataOffset, draws, instances,
+                     false);
+        vkCmdEndRendering(cmd);
+        return;
+    }
 
-    pipelines.trianglePipeline->bind(cmd);
+    // the secondaries continue the rendering begun below, so they have to
+    // know its attachment formats
+    VkCommandBufferInheritanceRenderingInfo inheritanceRendering{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+    inheritanceRendering.colorAttachmentCount = 1;
+    inheritanceRendering.pColorAttachmentFormats =
+            &_drawImage->get().imageFormat;
+    inheritanceRendering.depthAttachmentFormat = _depthImage->get().imageFormat;
+    inheritanceRendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritance.pNext = &inheritanceRendering;
+
+    VkCommandBufferBeginInfo secondaryBeginInfo = vkinit::command_buffer_begin_info(
+            VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+            VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    secondaryBeginInfo.pInheritanceInfo = &inheritance;
+
+    const size_t chunkSize = (draws.size() + chunkCount - 1) / chunkCount;
+
+    _workerPool->parallelFor(chunkCount, [&](uint32_t chunk) {
+        VK_CHECK(vkResetCommandPool(
+                _device, frame._workerCommandPools[chunk]->get(), 0));
+
+        const VkCommandBuffer secondary = frame._workerCommandBuffers[chunk];
+        VK_CHECK(vkBeginCommandBuffer(secondary, &secondaryBeginInfo));
+
+        const size_t first = chunk * chunkSize;
+        record_draws(secondary, globalDescriptor, sceneDataOffset,
+                     draws.subspan(first,
+                                   std::min(chunkSize, draws.size() - first)),
+                     instances, false);
+
+        VK_CHECK(vkEndCommandBuffer(secondary));
+    });
+
+    // chunks are executed in list order, so the result matches the serial path
+    renderInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    vkCmdBeginRendering(cmd, &renderInfo);
+    vkCmdExecuteCommands(cmd, chunkCount, frame._workerCommandBuffers.data());
+    vkCmdEndRendering(cmd);
+}
 
+void VulkanEngine::set_draw_viewport(VkCommandBuffer cmd) const {
     // set dynamic viewport and scissor
     VkViewport viewport = {};
     viewport.x = 0;
@@ -824,83 +1334,394 @@ void VulkanEngine::draw_geometry(VkCommandBuffer cmd) {
     scissor.extent.height = _drawExtent.height;
 
     vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
 
-    // bind a texture
-    VkDescriptorSet imageSet = get_current_frame()._frameDescriptors.allocate(
-            _device, _singleImageDescriptorLayout);
-    DescriptorWriter single_image_writer;
-    single_image_writer.write_image(0, _errorCheckerboardImage->imageView(),
-                                    _defaultSamplerNearest,
-                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                    VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    single_image_writer.update_set(_device, imageSet);
+void VulkanEngine::record_draws(VkCommandBuffer cmd,
+                                VkDescriptorSet globalDescriptor,
+                                uint32_t sceneDataOffset,
+                                std::span<const InstancedDraw> draws,
+                                VkDeviceAddress instanceBuffer,
+                                bool depthOnly) const {
+    set_draw_viewport(cmd);
+
+    // every surface indexes the shared index buffer
+    vkCmdBindIndexBuffer(cmd, geometry_buffer.index_buffer(), 0,
+                         VK_INDEX_TYPE_UINT32);
+
+    // materials live in the bindless table, so sets only change with the
+    // layout and the pipeline only when the material pass does
+    VkPipeline lastPipeline = VK_NULL_HANDLE;
+    VkPipelineLayout lastLayout = VK_NULL_HANDLE;
+    const VkDescriptorSet bindlessSet = bindless_table.set();
+    const bool meshShading = _config.meshShading && _meshShaderSupported;
+
+    for (const auto& [draw, firstInstance, instanceCount] : draws) {
+        const MaterialInstance* material = draw->material;
+        // blended surfaces would occlude what is behind them
+        if (depthOnly && material->passType == MaterialPass::Transparent) {
+            continue;
+        }
+        const bool meshlets = meshShading && draw->meshletCount > 0;
+        const MaterialPipeline* pipeline;
+        if (meshlets) {
+            pipeline =
+                    depthOnly
+                            ? &metalRoughMaterial.opaqueDepthMeshletPipeline
+                            : &metalRoughMaterial.meshlet_pipeline(
+                                      material->pipeline);
+        } else {
+            pipeline = depthOnly ? &metalRoughMaterial.opaqueDepthPipeline
+                                 : material->pipeline;
+        }
 
-    pipelines.meshPipeline->bindDescriptorSets(cmd, &imageSet, 1);
+        if (pipeline->pipeline != lastPipeline) {
+            lastPipeline = pipeline->pipeline;
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                              lastPipeline);
+        }
+        if (pipeline->layout != lastLayout) {
+            lastLayout = pipeline->layout;
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    lastLayout, 0, 1, &globalDescriptor, 1,
+                                    &sceneDataOffset);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    lastLayout, 1, 1, &bindlessSet, 0,
+                                    nullptr);
+        }
 
-    for (const auto& [indexCount, firstIndex, indexBuffer, material, transform,
-                      vertexBufferAddress] : mainDrawContext.OpaqueSurfaces) {
-        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          material->pipeline->pipeline);
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                material->pipeline->layout, 0, 1,
-                                &globalDescriptor, 0, nullptr);
-        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                material->pipeline->layout, 1, 1,
-                                &material->materialSet, 0, nullptr);
+        if (meshlets) {
+            GPUMeshletPushConstants pushConstants{};
+            pushConstants.positionDequant = draw->positionDequant;
+            pushConstants.vertexBuffer = draw->vertexBufferAddress;
+            pushConstants.instanceBuffer = instanceBuffer;
+            pushConstants.meshlets = draw->meshBuffers->meshlets;
+            pushConstants.meshletVertices = draw->meshBuffers->meshletVertices;
+            pushConstants.meshletTriangles =
+                    draw->meshBuffers->meshletTriangles;
+            pushConstants.materialIndex = material->materialIndex;
+            pushConstants.coneCull =
+                    (pipeline->cullMode & VK_CULL_MODE_BACK_BIT) != 0;
+
+            // x walks the meshlets in task workgroups of MESHLET_TASK_GROUP,
+            // y the instances. Draws past the device limits are split into
+            // meshlet and instance ranges
+            const uint32_t maxMeshlets =
+                    std::min(_maxTaskGroupCountX, _maxTaskGroupTotal) *
+                    MESHLET_TASK_GROUP;
+            for (uint32_t meshlet = 0; meshlet < draw->meshletCount;
+                 meshlet += maxMeshlets) {
+                const uint32_t meshletCount =
+                        std::min(draw->meshletCount - meshlet, maxMeshlets);
+                const uint32_t groups =
+                        (meshletCount + MESHLET_TASK_GROUP - 1) /
+                        MESHLET_TASK_GROUP;
+                const uint32_t maxInstances = std::min(
+                        _maxTaskGroupCountY, _maxTaskGroupTotal / groups);
+
+                for (uint32_t instance = 0; instance < instanceCount;
+                     instance += maxInstances) {
+                    pushConstants.firstMeshlet = draw->firstMeshlet + meshlet;
+                    pushConstants.meshletCount = meshletCount;
+                    pushConstants.firstInstance = firstInstance + instance;
+                    vkCmdPushConstants(cmd, pipeline->layout,
+                                       VK_SHADER_STAGE_TASK_BIT_EXT |
+                                               VK_SHADER_STAGE_MESH_BIT_EXT,
+                                       0, sizeof(GPUMeshletPushConstants),
+                                       &pushConstants);
+                    _vkCmdDrawMeshTasksEXT(
+                            cmd, groups,
+                            std::min(instanceCount - instance, maxInstances),
+                            1);
+                }
+            }
+            continue;
+        }
+
+        GPUInstancedPushConstants pushConstants{};
+        pushConstants.positionDequant = draw->positionDequant;
+        pushConstants.vertexBuffer = draw->vertexBufferAddress;
+        pushConstants.instanceBuffer = instanceBuffer;
+        pushConstants.materialIndex = material->materialIndex;
+        vkCmdPushConstants(cmd, pipeline->layout, VK_SHADER_STAGE_VERTEX_BIT,
+                           0, sizeof(GPUInstancedPushConstants),
+                           &pushConstants);
+
+        vkCmdDrawIndexed(cmd, draw->indexCount, instanceCount, draw->firstIndex,
+                         0, firstInstance);
+    }
+}
+
+InstancedDrawList VulkanEngine::build_instanced_draws(
+        std::span<const RenderObject> draws) {
+    InstancedDrawList drawList{};
+    if (draws.empty()) {
+        return drawList;
+    }
 
-        vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    const auto sameSurface = [](const RenderObject& l, const RenderObject& r) {
+        return l.material == r.material && l.firstIndex == r.firstIndex &&
+               l.indexCount == r.indexCount &&
+               l.vertexBufferAddress == r.vertexBufferAddress;
+    };
 
-        GPUDrawPushConstants pushConstants{};
-        pushConstants.vertexBuffer = vertexBufferAddress;
-        pushConstants.worldMatrix = transform;
-        vkCmdPushConstants(cmd, material->pipeline->layout,
-                           VK_SHADER_STAGE_VERTEX_BIT, 0,
-                           sizeof(GPUDrawPushConstants), &pushConstants);
+    // copies of a surface end up next to each other, sorted by pipeline
+    // first so binds stay as rare as before
+    std::vector<uint32_t> order(draws.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        const RenderObject& l = draws[a];
+        const RenderObject& r = draws[b];
+        if (l.material->pipeline != r.material->pipeline) {
+            return std::less<>{}(l.material->pipeline, r.material->pipeline);
+        }
+        if (l.material != r.material) {
+            return std::less<>{}(l.material, r.material);
+        }
+        return l.firstIndex < r.firstIndex;
+    });
 
-        vkCmdDrawIndexed(cmd, indexCount, 1, firstIndex, 0, 0);
+    drawList.instances =
+            frame_ring.allocate(sizeof(glm::mat3x4) * draws.size());
+    auto* instances = static_cast<glm::mat3x4*>(drawList.instances.data);
+
+    for (uint32_t i = 0; i < order.size(); i++) {
+        const RenderObject& draw = draws[order[i]];
+
+        if (drawList.draws.empty() ||
+            !sameSurface(*drawList.draws.back().draw, draw)) {
+            drawList.draws.push_back({&draw, i, 0});
+        }
+        drawList.draws.back().instanceCount++;
+        instances[i] = pack_transform(draw.transform);
     }
 
-    vkCmdEndRendering(cmd);
+    return drawList;
 }
 
-void VulkanEngine::draw() {
-    update_scene();
+IndirectDrawList VulkanEngine::build_indirect_draws(
+        std::span<const RenderObject> draws) {
+    IndirectDrawList drawList{};
+    if (draws.empty()) {
+        return drawList;
+    }
 
-    // wait until the gpu has finished rendering the last frame. Timeout of 1
-    // second
-    VK_CHECK(vkWaitForFences(_device, 1, get_current_frame()._renderFence->getPtr(),
-                             true, 1000000000));
+    // draws sharing a pipeline become one indirect call, every mesh lives
+    // in the same index buffer. The sort is stable so an unchanged scene
+    // keeps its draw order, which the occlusion culling relies on to track
+    // visibility across frames
+    std::vector<uint32_t> order(draws.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return std::less<>{}(draws[a].material->pipeline,
+                             draws[b].material->pipeline);
+    });
+
+    drawList.sourceCommands = frame_ring.allocate(
+            sizeof(VkDrawIndexedIndirectCommand) * draws.size());
+    drawList.drawData = frame_ring.allocate(sizeof(GPUDrawData) * draws.size());
+    auto* commands = static_cast<VkDrawIndexedIndirectCommand*>(
+            drawList.sourceCommands.data);
+    auto* drawData = static_cast<GPUDrawData*>(drawList.drawData.data);
+
+    std::vector<IndirectBatch>& batches = drawList.batches;
+    for (uint32_t i = 0; i < order.size(); i++) {
+        const RenderObject& draw = draws[order[i]];
+
+        if (batches.empty() ||
+            batches.back().pipeline != draw.material->pipeline) {
+            batches.push_back({draw.material->pipeline, i, 0});
+        }
+        batches.back().count++;
+
+        // firstInstance carries the draw index into the vertex shader
+        commands[i].indexCount = draw.indexCount;
+        commands[i].instanceCount = 1;
+        commands[i].firstIndex = draw.firstIndex;
+        commands[i].vertexOffset = 0;
+        commands[i].firstInstance = i;
+
+        drawData[i].worldMatrix = pack_transform(draw.transform);
+        drawData[i].boundingSphere =
+                glm::vec4(draw.bounds.origin, draw.bounds.sphereRadius);
+        drawData[i].positionDequant = draw.positionDequant;
+        drawData[i].vertexBuffer = draw.vertexBufferAddress;
+        drawData[i].materialIndex = draw.material->materialIndex;
+        drawData[i].batch = static_cast<uint32_t>(batches.size() - 1);
+    }
 
-    // Clear frame buffers instead of flushing deletion queue
-    get_current_frame()._frameBuffers.clear();
-    get_current_frame()._frameDescriptors.clear_pools(_device);
+    drawList.batchCounts =
+            frame_ring.allocate(sizeof(GPUIndirectBatch) * batches.size());
+    auto* batchCounts =
+            static_cast<GPUIndirectBatch*>(drawList.batchCounts.data);
+    for (size_t i = 0; i < batches.size(); i++) {
+        batchCounts[i] = {batches[i].count, batches[i].first};
+    }
+    drawList.commands = drawList.sourceCommands;
 
-    VK_CHECK(vkResetFences(_device, 1, get_current_frame()._renderFence->getPtr()));
+    return drawList;
+}
 
-    // request image from the swapchain
-    uint32_t swapchainImageIndex;
-    const VkResult e =
-            vkAcquireNextImageKHR(_device, _swapchain, 1000000000,
-                                  get_current_frame()._swapchainSemaphore->get(),
-                                  nullptr, &swapchainImageIndex);
-    if (e == VK_ERROR_OUT_OF_DATE_KHR) {
-        resize_requested = true;
+void VulkanEngine::cull_indirect_draws(VkCommandBuffer cmd,
+                                       IndirectDrawList& drawList,
+                                       CullPhase phase) {
+    if (drawList.batches.empty()) {
         return;
     }
+    const uint32_t drawCount =
+            drawList.batches.back().first + drawList.batches.back().count;
+
+    // the cull pass counts survivors up from zero and compacts their
+    // commands to the front of each batch's range
+    drawList.batchCounts = frame_ring.allocate(sizeof(GPUIndirectBatch) *
+                                               drawList.batches.size());
+    auto* batchCounts =
+            static_cast<GPUIndirectBatch*>(drawList.batchCounts.data);
+    for (size_t i = 0; i < drawList.batches.size(); i++) {
+        batchCounts[i] = {0, drawList.batches[i].first};
+    }
+    drawList.commands = frame_ring.allocate(
+            sizeof(VkDrawIndexedIndirectCommand) * drawCount);
+
+    const Frustum frustum = vkutil::extract_frustum(sceneData.viewproj);
+    const VkExtent3D depthExtent = _depthImage->get().imageExtent;
+
+    GPUCullData cullData{};
+    std::copy(frustum.planes.begin(), frustum.planes.end(), cullData.frustum);
+    cullData.view = sceneData.view;
+    cullData.projection = glm::vec4(sceneData.proj[0][0], sceneData.proj[1][1],
+                                    sceneData.proj[2][2], sceneData.proj[3][2]);
+    cullData.pyramidSize = glm::vec2(depth_pyramid.extent().width,
+                                     depth_pyramid.extent().height);
+    cullData.pyramidUvScale =
+            glm::vec2(static_cast<float>(_drawExtent.width) / depthExtent.width,
+                      static_cast<float>(_drawExtent.height) /
+                              depthExtent.height);
+    cullData.drawData = drawList.drawData.address;
+    cullData.inCommands = drawList.sourceCommands.address;
+    cullData.outCommands = drawList.commands.address;
+    cullData.batches = drawList.batchCounts.address;
+    cullData.visibility = _drawVisibilityAddress;
+    cullData.drawCount = drawCount;
+    cullData.phase = phase;
+    cullData.znear = CAMERA_NEAR;
+
+    GPUCullPushConstants pushConstants{};
+    pushConstants.cullData = frame_ring.push(cullData).address;
+
+    const VkDescriptorSet pyramidSet = depth_pyramid.sample_set();
+    pipelines.cullPipeline->bind(cmd);
+    pipelines.cullPipeline->bindDescriptorSets(cmd, &pyramidSet, 1);
+    pipelines.cullPipeline->pushConstants(cmd, 0, sizeof(pushConstants),
+                                          &pushConstants);
+    pipelines.cullPipeline->dispatch(cmd, (drawCount + 63) / 64, 1);
+
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT |
+                            VK_ACCESS_2_SHADER_STORAGE_READ_BIT;
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
 
-    // naming it cmd for shorter writing
-    const VkCommandBuffer cmd = get_current_frame()._mainCommandBuffer;
+void VulkanEngine::reserve_draw_visibility(VkCommandBuffer cmd,
+                                           uint32_t drawCount) {
+    if (drawCount <= _drawVisibilityCapacity) {
+        return;
+    }
 
-    // now that we are sure that the commands finished executing, we can safely
-    // reset the command buffer to begin recording again.
-    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+    // earlier frames may still read the old buffer
+    if (_drawVisibility.buffer != VK_NULL_HANDLE) {
+        retire_buffer(_drawVisibility);
+    }
 
-    // begin the command buffer recording. We will use this command buffer
-    // exactly once, so we want to let vulkan know that
-    const VkCommandBufferBeginInfo cmdBeginInfo =
-            vkinit::command_buffer_begin_info(
-                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    _drawVisibilityCapacity = std::max(drawCount, _drawVisibilityCapacity * 2);
+    _drawVisibility = create_buffer(
+            sizeof(uint32_t) * _drawVisibilityCapacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+
+    const VkBufferDeviceAddressInfo addressInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = _drawVisibility.buffer};
+    _drawVisibilityAddress = vkGetBufferDeviceAddress(_device, &addressInfo);
+
+    // nothing counts as visible yet, the late phase draws what it finds
+    vkCmdFillBuffer(cmd, _drawVisibility.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = VK_PIPELINE_STAGE_2_CLEAR_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_SHADER_STORAGE_READ_BIT |
+                            VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+void VulkanEngine::record_indirect_draws(
+        VkCommandBuffer cmd, VkDescriptorSet globalDescriptor,
+        uint32_t sceneDataOffset, const IndirectDrawList& drawList,
+        bool depthOnly) const {
+    if (drawList.batches.empty()) {
+        return;
+    }
+
+    set_draw_viewport(cmd);
+    vkCmdBindIndexBuffer(cmd, geometry_buffer.index_buffer(), 0,
+                         VK_INDEX_TYPE_UINT32);
+
+    const VkDescriptorSet bindlessSet = bindless_table.set();
+    GPUIndirectPushConstants pushConstants{};
+    pushConstants.drawData = drawList.drawData.address;
 
+    VkPipelineLayout lastLayout = VK_NULL_HANDLE;
+    for (size_t i = 0; i < drawList.batches.size(); i++) {
+        const IndirectBatch& batch = drawList.batches[i];
+        if (depthOnly &&
+            batch.pipeline == &metalRoughMaterial.transparentPipeline) {
+            continue;
+        }
+        const MaterialPipeline& pipeline =
+                depthOnly ? metalRoughMaterial.opaqueDepthIndirectPipeline
+                          : metalRoughMaterial.indirect_pipeline(batch.pipeline);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          pipeline.pipeline);
+        if (pipeline.layout != lastLayout) {
+            lastLayout = pipeline.layout;
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    lastLayout, 0, 1, &globalDescriptor, 1,
+                                    &sceneDataOffset);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    lastLayout, 1, 1, &bindlessSet, 0,
+                                    nullptr);
+            vkCmdPushConstants(cmd, lastLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(GPUIndirectPushConstants),
+                               &pushConstants);
+        }
+
+        vkCmdDrawIndexedIndirectCount(
+                cmd, drawList.commands.buffer,
+                drawList.commands.offset +
+                        batch.first * sizeof(VkDrawIndexedIndirectCommand),
+                drawList.batchCounts.buffer,
+                drawList.batchCounts.offset + i * sizeof(GPUIndirectBatch),
+                batch.count, sizeof(VkDrawIndexedIndirectCommand));
+    }
+}
+
+void VulkanEngine::update_draw_extent() {
     _drawExtent.height = static_cast<uint32_t>(
             (float)std::min(_swapchainExtent.height,
                             _drawImage->get().imageExtent.height) *
@@ -909,20 +1730,106 @@ void VulkanEngine::draw() {
             (float)std::min(_swapchainExtent.width,
                             _drawImage->get().imageExtent.width) *
             renderScale);
+}
+
+void VulkanEngine::draw() {
+    const auto start = std::chrono::steady_clock::now();
+
+    // the projection and the LOD selection of update_scene depend on it
+    update_draw_extent();
+
+    // ahead of gathering the scene, which reads the mesh offsets. The copies
+    // run at the start of the frame, nothing waits for the GPU
+    if (geometry_buffer.fragmentation() > _config.geometryCompactThreshold) {
+        compact_geometry();
+    }
+
+    // in low latency mode the camera is sampled once the frame slot is free,
+    // right before recording, instead of before blocking on the GPU
+    if (!_config.lowLatency) {
+        update_scene();
+    }
+
+    wait_for_frame(get_current_frame());
+
+    if (frame_ring.begin_frame(_frameNumber % _framesInFlight)) {
+        write_scene_data_descriptors();
+    }
+
+    transfer_queue.collect();
+    asset_cache.collect();
+    collect_retired_buffers();
+
+    if (_config.lowLatency) {
+        update_scene();
+    }
+
+    // request image from the swapchain. Low latency mode postpones this until
+    // the scene has been submitted
+    uint32_t swapchainImageIndex = 0;
+    if (!_config.headless && !_config.lowLatency) {
+        if (!acquire_swapchain_image(swapchainImageIndex)) {
+            return;
+        }
+    }
+
+    // the background overwrites the whole draw image, which the previous
+    // frame may still be copying out of
+    const bool asyncBackground = _config.asyncCompute;
+    if (asyncBackground) {
+        schedule_compute({.record =
+                                  [this](VkCommandBuffer computeCmd) {
+                                      vkutil::transition_image(
+                                              computeCmd, _drawImage->image(),
+                                              VK_IMAGE_LAYOUT_UNDEFINED,
+                                              VK_IMAGE_LAYOUT_GENERAL);
+                                      draw_background(computeCmd);
+                                  },
+                          .waitPreviousFrame = true});
+    }
+
+    // compute goes first so the graphics submission can wait on it
+    submit_compute();
+
+    // naming it cmd for shorter writing
+    VkCommandBuffer cmd = get_current_frame()._mainCommandBuffer;
+
+    // now that we are sure that the commands finished executing, we can safely
+    // reset the command buffer to begin recording again.
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+
+    // begin the command buffer recording. We will use this command buffer
+    // exactly once, so we want to let vulkan know that
+    const VkCommandBufferBeginInfo cmdBeginInfo =
+            vkinit::command_buffer_begin_info(
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
 
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
 
-    // transition our main draw image into general layout, so we can write into
-    // it, we will overwrite it all, so we don't care about what was the older
-    // layout
-    vkutil::transition_image(cmd, _drawImage->image(), VK_IMAGE_LAYOUT_UNDEFINED,
-                             VK_IMAGE_LAYOUT_GENERAL);
+    // take ownership of everything uploaded since the last frame
+    _transferWaitValue = transfer_queue.record_acquires(cmd);
+    // geometry buffers replaced since the last frame, before any draw
+    geometry_buffer.record_rebuilds(cmd);
+
+    if (!asyncBackground) {
+        // transition our main draw image into general layout, so we can write
+        // into it, we will overwrite it all, so we don't care about what was
+        // the older layout
+        vkutil::transition_image(cmd, _drawImage->image(),
+                                 VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_IMAGE_LAYOUT_GENERAL);
 
-    draw_background(cmd);
+        draw_background(cmd);
+    }
 
     vkutil::transition_image(cmd, _drawImage->image(), VK_IMAGE_LAYOUT_GENERAL,
                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
+    // every pass of draw_geometry after the first loads the depth
+    vkutil::transition_image(cmd, _depthImage->image(),
+                             VK_IMAGE_LAYOUT_UNDEFINED,
+                             VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
     draw_geometry(cmd);
 
     // transition the draw image and the swapchain image into their correct
@@ -930,6 +1837,37 @@ void VulkanEngine::draw() {
     vkutil::transition_image(cmd, _drawImage->image(),
                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                              VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+    // in headless mode the frame ends in the draw image, ready to be copied
+    // out by whoever needs it
+    if (_config.headless) {
+        VK_CHECK(vkEndCommandBuffer(cmd));
+
+        submit_frame(cmd, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+        _frameNumber++;
+        stats.frameCount++;
+        stats.frametime = std::chrono::duration<float, std::milli>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+        return;
+    }
+
+    if (_config.lowLatency) {
+        // hand the scene to the GPU first, then block on the swapchain. Only
+        // the copy and the UI are left waiting for the image
+        VK_CHECK(vkEndCommandBuffer(cmd));
+        submit_frame(cmd, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+        if (!acquire_swapchain_image(swapchainImageIndex)) {
+            return;
+        }
+
+        cmd = get_current_frame()._presentCommandBuffer;
+        VK_CHECK(vkResetCommandBuffer(cmd, 0));
+        VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+    }
+
     vkutil::transition_image(cmd, _swapchainImages[swapchainImageIndex],
                              VK_IMAGE_LAYOUT_UNDEFINED,
                              VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
@@ -956,28 +1894,13 @@ void VulkanEngine::draw() {
     // now be executed)
     VK_CHECK(vkEndCommandBuffer(cmd));
 
-    // prepare the submission to the queue.
-    // we want to wait on the _presentSemaphore, as that semaphore is signaled
-    // when the swapchain is ready we will signal the _renderSemaphore, to
-    // signal that rendering has finished
-
-    const VkCommandBufferSubmitInfo cmdinfo =
-            vkinit::command_buffer_submit_info(cmd);
-
-    const VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(
-            VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
-            get_current_frame()._swapchainSemaphore->get());
-    const VkSemaphoreSubmitInfo signalInfo =
-            vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT,
-                                          get_current_frame()._renderSemaphore->get());
-
-    const VkSubmitInfo2 submit =
-            vkinit::submit_info(&cmdinfo, &signalInfo, &waitInfo);
-
-    // submit command buffer to the queue and execute it.
-    //  _renderFence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit,
-                            get_current_frame()._renderFence->get()));
+    // submit the frame. We wait on the _swapchainSemaphore, as that semaphore
+    // is signaled when the swapchain is ready, and signal the render semaphore
+    // of the image to tell present that rendering has finished
+    const VkSemaphore renderSemaphore =
+            _renderSemaphores[swapchainImageIndex]->get();
+    submit_frame(cmd, get_current_frame()._swapchainSemaphore->get(),
+                 renderSemaphore);
 
     // prepare present
     //  this will put the image we just rendered to into the visible window.
@@ -990,7 +1913,7 @@ void VulkanEngine::draw() {
     presentInfo.pSwapchains = &_swapchain;
     presentInfo.swapchainCount = 1;
 
-    presentInfo.pWaitSemaphores = get_current_frame()._renderSemaphore->getPtr();
+    presentInfo.pWaitSemaphores = &renderSemaphore;
     presentInfo.waitSemaphoreCount = 1;
 
     presentInfo.pImageIndices = &swapchainImageIndex;
@@ -1002,6 +1925,163 @@ void VulkanEngine::draw() {
 
     // increase the number of frames drawn
     _frameNumber++;
+    stats.frameCount++;
+    stats.frametime = std::chrono::duration<float, std::milli>(
+                              std::chrono::steady_clock::now() - start)
+                              .count();
+}
+
+void VulkanEngine::wait_for_frame(FrameData& frame) {
+    const auto start = std::chrono::steady_clock::now();
+
+    // wait until the gpu has finished the last submission that used this
+    // frame's resources. Timeout of 1 second
+    VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = _frameTimeline->getPtr();
+    waitInfo.pValues = &frame._timelineValue;
+
+    VK_CHECK(vkWaitSemaphores(_device, &waitInfo, 1000000000));
+
+    stats.fenceWaitTime = std::chrono::duration<float, std::milli>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+}
+
+void VulkanEngine::submit_frame(VkCommandBuffer cmd, VkSemaphore waitSemaphore,
+                                VkSemaphore signalSemaphore) {
+    FrameData& frame = get_current_frame();
+    frame._timelineValue = ++_frameTimelineValue;
+
+    const VkCommandBufferSubmitInfo cmdinfo =
+            vkinit::command_buffer_submit_info(cmd);
+
+    std::array<VkSemaphoreSubmitInfo, 3> waitInfos{};
+    uint32_t waitCount = 0;
+
+    if (waitSemaphore != VK_NULL_HANDLE) {
+        waitInfos[waitCount++] = vkinit::semaphore_submit_info(
+                VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+                waitSemaphore);
+    }
+
+    // uploads this frame acquired must have landed before anything runs
+    if (_transferWaitValue != 0) {
+        waitInfos[waitCount] = vkinit::semaphore_submit_info(
+                VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, transfer_queue.timeline());
+        waitInfos[waitCount++].value = _transferWaitValue;
+        _transferWaitValue = 0;
+    }
+
+    if (_computeWaitValue != 0) {
+        waitInfos[waitCount] = vkinit::semaphore_submit_info(
+                _computeWaitStage, _computeTimeline->get());
+        waitInfos[waitCount++].value = _computeWaitValue;
+        _computeWaitValue = 0;
+        _computeWaitStage = VK_PIPELINE_STAGE_2_NONE;
+    }
+
+    std::array<VkSemaphoreSubmitInfo, 2> signalInfos{};
+    uint32_t signalCount = 0;
+
+    signalInfos[signalCount] = vkinit::semaphore_submit_info(
+            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _frameTimeline->get());
+    signalInfos[signalCount++].value = frame._timelineValue;
+
+    if (signalSemaphore != VK_NULL_HANDLE) {
+        signalInfos[signalCount++] = vkinit::semaphore_submit_info(
+                VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, signalSemaphore);
+    }
+
+    VkSubmitInfo2 submit =
+            vkinit::submit_info(&cmdinfo, signalInfos.data(), waitInfos.data());
+    submit.signalSemaphoreInfoCount = signalCount;
+    submit.waitSemaphoreInfoCount = waitCount;
+
+    VK_CHECK(vkQueueSubmit2(_graphicsQueue, 1, &submit, VK_NULL_HANDLE));
+}
+
+void VulkanEngine::schedule_compute(ComputePass pass) {
+    _computePasses.push_back(std::move(pass));
+}
+
+void VulkanEngine::submit_compute() {
+    if (_computePasses.empty()) {
+        return;
+    }
+
+    // the graphics submission of this frame slot waits on this one, so the
+    // frame timeline wait in draw() also covers the compute command buffer
+    const VkCommandBuffer cmd = get_current_frame()._computeCommandBuffer;
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+
+    const VkCommandBufferBeginInfo cmdBeginInfo =
+            vkinit::command_buffer_begin_info(
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+    bool waitPreviousFrame = false;
+    for (const ComputePass& pass : _computePasses) {
+        pass.record(cmd);
+        _computeWaitStage |= pass.graphicsWaitStage;
+        waitPreviousFrame |= pass.waitPreviousFrame;
+    }
+    _computePasses.clear();
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    const VkCommandBufferSubmitInfo cmdinfo =
+            vkinit::command_buffer_submit_info(cmd);
+
+    VkSemaphoreSubmitInfo waitInfo = vkinit::semaphore_submit_info(
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, _frameTimeline->get());
+    waitInfo.value = _frameTimelineValue;
+
+    VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(
+            VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, _computeTimeline->get());
+    signalInfo.value = ++_computeTimelineValue;
+
+    const VkSubmitInfo2 submit = vkinit::submit_info(
+            &cmdinfo, &signalInfo, waitPreviousFrame ? &waitInfo : nullptr);
+    VK_CHECK(vkQueueSubmit2(_computeQueue, 1, &submit, VK_NULL_HANDLE));
+
+    _computeWaitValue = _computeTimelineValue;
+}
+
+bool VulkanEngine::acquire_swapchain_image(uint32_t& imageIndex) {
+    const VkResult e = vkAcquireNextImageKHR(
+            _device, _swapchain, 1000000000,
+            get_current_frame()._swapchainSemaphore->get(), nullptr,
+            &imageIndex);
+    if (e == VK_ERROR_OUT_OF_DATE_KHR) {
+        resize_requested = true;
+        return false;
+    }
+    return true;
+}
+
+void VulkanEngine::set_present_mode(VkPresentModeKHR mode) {
+    if (mode == _config.presentMode) {
+        return;
+    }
+    _config.presentMode = mode;
+    if (!_config.headless) {
+        resize_requested = true;
+    }
+}
+
+void VulkanEngine::set_frames_in_flight(uint32_t count) {
+    count = std::clamp(count, 1u, MAX_FRAMES_IN_FLIGHT);
+    if (count == _framesInFlight) {
+        return;
+    }
+
+    // frame slots are picked as _frameNumber % _framesInFlight, so every
+    // slot has to be free before the mapping changes
+    vkDeviceWaitIdle(_device);
+
+    _framesInFlight = count;
+    _config.framesInFlight = count;
 }
 
 void VulkanEngine::resize_swapchain() {
@@ -1036,9 +2116,7 @@ AllocatedImage VulkanEngine::create_image(VkExtent3D size, VkFormat format,
 
     VkImageCreateInfo img_info = vkinit::image_create_info(format, usage, size);
     if (mipmapped) {
-        img_info.mipLevels = static_cast<uint32_t>(std::floor(std::log2(
-                                     std::max(size.width, size.height)))) +
-                             1;
+        img_info.mipLevels = vkutil::mip_count({size.width, size.height});
     }
 
     // always allocate images on dedicated GPU memory
@@ -1072,50 +2150,88 @@ AllocatedImage VulkanEngine::create_image(VkExtent3D size, VkFormat format,
 AllocatedImage VulkanEngine::create_image(const void* data, VkExtent3D size,
                                           VkFormat format,
                                           VkImageUsageFlags usage,
-                                          bool mipmapped) const {
-    const size_t data_size = size.depth * size.width * size.height * 4;
-    const AllocatedBuffer uploadbuffer =
-            create_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                          VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    memcpy(uploadbuffer.info.pMappedData, data, data_size);
-
-    const AllocatedImage new_image =
-            create_image(size, format,
-                         usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
-                                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-                         mipmapped);
-
-    command_buffers.immediate_submit([&](VkCommandBuffer cmd) {
-        vkutil::transition_image(cmd, new_image.image,
-                                 VK_IMAGE_LAYOUT_UNDEFINED,
-                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+                                          bool mipmapped,
+                                          UploadTicket* ticket) {
+    const ImageData image{data, size, format, usage, mipmapped};
+    const std::vector<AllocatedImage> images = create_images({&image, 1}, ticket);
+    return images.empty() ? AllocatedImage{} : images.front();
+}
 
-        VkBufferImageCopy copyRegion = {};
-        copyRegion.bufferOffset = 0;
-        copyRegion.bufferRowLength = 0;
-        copyRegion.bufferImageHeight = 0;
+std::vector<AllocatedImage> VulkanEngine::create_images(
+        std::span<const ImageData> images, UploadTicket* ticket) {
+    if (images.empty()) {
+        return {};
+    }
 
-        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        copyRegion.imageSubresource.mipLevel = 0;
-        copyRegion.imageSubresource.baseArrayLayer = 0;
-        copyRegion.imageSubresource.layerCount = 1;
-        copyRegion.imageExtent = size;
+    // copy offsets must be a multiple of the texel size, 16 covers them all
+    std::vector<VkDeviceSize> offsets(images.size());
+    VkDeviceSize stagingSize = 0;
+    for (size_t i = 0; i < images.size(); i++) {
+        const ImageData& image = images[i];
+        const uint32_t texelSize = vkutil::format_texel_size(image.format);
+        if (texelSize == 0) {
+            LOGE("create_images: unsupported format {} for image {}",
+                 static_cast<int>(image.format), i);
+            return {};
+        }
+        offsets[i] = stagingSize;
+        stagingSize += (static_cast<VkDeviceSize>(image.size.width) *
+                                image.size.height * image.size.depth *
+                                texelSize +
+                        15) &
+                       ~VkDeviceSize{15};
+    }
 
-        // copy the buffer into the image
-        vkCmdCopyBufferToImage(cmd, uploadbuffer.buffer, new_image.image,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
-                               &copyRegion);
+    const AllocatedBuffer staging =
+            create_buffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                          VMA_MEMORY_USAGE_CPU_TO_GPU);
+    auto* stagingData = static_cast<std::byte*>(staging.info.pMappedData);
+
+    std::vector<AllocatedImage> newImages;
+    std::vector<ImageUpload> uploads;
+    newImages.reserve(images.size());
+    uploads.reserve(images.size());
+    for (size_t i = 0; i < images.size(); i++) {
+        const ImageData& image = images[i];
+        memcpy(stagingData + offsets[i], image.data,
+               static_cast<size_t>(image.size.width) * image.size.height *
+                       image.size.depth *
+                       vkutil::format_texel_size(image.format));
+
+        // 3D images and formats without linear blits keep a single level
+        const bool mipmapped = image.mipmapped && image.size.depth == 1 &&
+                               supports_mip_generation(image.format);
+        const AllocatedImage newImage = create_image(
+                image.size, image.format,
+                image.usage | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                mipmapped);
+        newImages.push_back(newImage);
+
+        const uint32_t mipLevels =
+                mipmapped ? vkutil::mip_count({image.size.width,
+                                               image.size.height})
+                          : 1;
+        uploads.push_back({newImage.image, offsets[i], image.size, mipLevels});
+    }
 
-        vkutil::transition_image(cmd, new_image.image,
-                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                 VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-            },
-            (VulkanEngine*)this);
+    // the transfer queue frees the staging buffer once the copies are done
+    const UploadTicket uploadTicket =
+            transfer_queue.upload_images(staging, uploads);
+    if (ticket != nullptr) {
+        *ticket = uploadTicket;
+    }
 
-    destroy_buffer(uploadbuffer);
+    return newImages;
+}
 
-    return new_image;
+bool VulkanEngine::supports_mip_generation(VkFormat format) const {
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(_chosenGPU, format, &properties);
+    constexpr VkFormatFeatureFlags required =
+            VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+            VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
 }
 
 void VulkanEngine::destroy_image(const AllocatedImage& img) const {
@@ -1126,15 +2242,21 @@ void VulkanEngine::destroy_image(const AllocatedImage& img) const {
 void MeshNode::Draw(const glm::mat4& topMatrix, DrawContext& ctx) {
     const glm::mat4 nodeMatrix = topMatrix * worldTransform;
 
-    for (auto& [startIndex, count, material] : mesh->surfaces) {
+    for (const GeoSurface& surface : mesh->surfaces) {
         RenderObject def{};
-        def.indexCount = count;
-        def.firstIndex = startIndex;
-        def.indexBuffer = mesh->meshBuffers.indexBuffer.buffer;
-        def.material = &material->data;
+        def.indexCount = surface.count;
+        def.firstIndex = surface.startIndex;
+        def.material = &surface.material->data;
 
         def.transform = nodeMatrix;
-        def.vertexBufferAddress = mesh->meshBuffers.vertexBufferAddress;
+        def.vertexBufferAddress = ctx.vertexBufferAddress +
+                                  mesh->meshBuffers.geometry.vertexOffset;
+        def.positionDequant = mesh->meshBuffers.positionDequant;
+        def.bounds = surface.bounds;
+        def.lods = surface.lods;
+        def.meshBuffers = &mesh->meshBuffers;
+        def.firstMeshlet = surface.firstMeshlet;
+        def.meshletCount = surface.meshletCount;
 
         ctx.OpaqueSurfaces.push_back(def);
     }
@@ -1147,10 +2269,13 @@ void VulkanEngine::update_scene() {
 
     const glm::mat4 view = mainCamera->getViewMatrix();
 
-    glm::mat4 projection = glm::perspective(
+    // near and far are swapped for reversed depth, which matches the
+    // GREATER depth tests of the pipelines and keeps precision far away.
+    // Spelled out as 0..1 depth, the -1..1 default would clip everything
+    glm::mat4 projection = glm::perspectiveRH_ZO(
             glm::radians(70.f),
-            (float)_windowExtent.width / (float)_windowExtent.height, 0.1f,
-            10000.f);
+            (float)_drawExtent.width / (float)_drawExtent.height,
+            CAMERA_FAR, CAMERA_NEAR);
 
     // to opengl and gltf axis
     projection[1][1] *= -1;
@@ -1160,47 +2285,140 @@ void VulkanEngine::update_scene() {
     sceneData.viewproj = projection * view;
 
     mainDrawContext.OpaqueSurfaces.clear();
+    mainDrawContext.vertexBufferAddress = geometry_buffer.vertex_address();
 
     sceneData.ambientColor = glm::vec4(.1f);
     sceneData.sunlightColor = glm::vec4(1.f);
     sceneData.sunlightDirection = glm::vec4(0, 1, 0.5, 1.f);
 
-    for (const auto& [key, mesh] : meshes) {
-        const std::shared_ptr<LoadedGLTF> loadedMesh = mesh;
-        loadedMesh->Draw(transforms[key], mainDrawContext);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        meshes[i]->Draw(transforms[i], mainDrawContext);
+    }
+
+    stats.surfaceCount =
+            static_cast<uint32_t>(mainDrawContext.OpaqueSurfaces.size());
+    if (_config.cpuCulling && !(_config.indirectDraw && _config.gpuCulling)) {
+        cull_surfaces();
+    }
+    select_lods();
+
+    stats.visibleCount =
+            static_cast<uint32_t>(mainDrawContext.OpaqueSurfaces.size());
+    stats.triangleCount = 0;
+    for (const RenderObject& surface : mainDrawContext.OpaqueSurfaces) {
+        stats.triangleCount += surface.indexCount / 3;
     }
 }
 
-int64_t VulkanEngine::registerMesh(const std::string& filePath) {
-    std::random_device rd;
+void VulkanEngine::cull_surfaces() {
+    std::vector<RenderObject>& surfaces = mainDrawContext.OpaqueSurfaces;
+
+    _cullSpheres.clear();
+    for (const RenderObject& surface : surfaces) {
+        const glm::mat4& m = surface.transform;
+        const glm::vec3 center{m * glm::vec4(surface.bounds.origin, 1.f)};
+        const float scale = std::max({glm::length(glm::vec3(m[0])),
+                                      glm::length(glm::vec3(m[1])),
+                                      glm::length(glm::vec3(m[2]))});
+        _cullSpheres.push(
+                glm::vec4(center, surface.bounds.sphereRadius * scale));
+    }
 
-    // Use the Mersenne Twister engine for high-quality random numbers
-    std::mt19937_64 generator(rd());
+    // projected radius in screen heights is radius * proj[1][1] / (2 depth)
+    ScreenSizeCull screenSize{};
+    screenSize.depthPlane = -glm::vec4(sceneData.view[0][2],
+                                       sceneData.view[1][2],
+                                       sceneData.view[2][2],
+                                       sceneData.view[3][2]);
+    screenSize.minRadiusOverDepth = 2.f * _config.cullMinScreenSize /
+                                    std::abs(sceneData.proj[1][1]);
+
+    vkutil::cull_spheres(vkutil::extract_frustum(sceneData.viewproj),
+                         screenSize, _cullSpheres, _cullVisible);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < surfaces.size(); i++) {
+        if (_cullVisible[i]) {
+            surfaces[kept++] = surfaces[i];
+        }
+    }
+    surfaces.resize(kept);
+}
 
-    // Create a uniform distribution for int64_t
-    std::uniform_int_distribution<int64_t> distribution;
+void VulkanEngine::select_lods() {
+    if (_config.lodErrorPixels <= 0.f) {
+        return;
+    }
 
-    // Generate and print a random int64_t value
-    const int64_t random_int64 = distribution(generator);
+    const glm::vec3 cameraPosition = glm::inverse(sceneData.view)[3];
+    // pixels covered by one world unit at distance 1
+    const float pixelsPerUnit = std::abs(sceneData.proj[1][1]) * 0.5f *
+                                static_cast<float>(_drawExtent.height);
 
-    const std::string structurePath = {std::string(ASSETS_DIR) + filePath};
-    const auto structureFile = loadGltf(this, structurePath);
+    for (RenderObject& surface : mainDrawContext.OpaqueSurfaces) {
+        if (surface.lods.empty()) {
+            continue;
+        }
 
-    assert(structureFile.has_value());
+        const glm::mat4& m = surface.transform;
+        const glm::vec3 center{m * glm::vec4(surface.bounds.origin, 1.f)};
+        const float scale = std::max({glm::length(glm::vec3(m[0])),
+                                      glm::length(glm::vec3(m[1])),
+                                      glm::length(glm::vec3(m[2]))});
+
+        // the nearest point of the bounding sphere sees the largest error
+        const float distance = std::max(
+                glm::distance(center, cameraPosition) -
+                        surface.bounds.sphereRadius * scale,
+                CAMERA_NEAR);
+        const float maxError =
+                _config.lodErrorPixels * distance / (pixelsPerUnit * scale);
+
+        // levels get coarser and their errors grow
+        for (auto lod = surface.lods.rbegin(); lod != surface.lods.rend();
+             ++lod) {
+            if (lod->error <= maxError) {
+                surface.firstIndex = lod->startIndex;
+                surface.indexCount = lod->count;
+                // meshlets only cover the full surface
+                surface.meshletCount = 0;
+                break;
+            }
+        }
+    }
+}
+
+SlotHandle VulkanEngine::registerMesh(const std::string& filePath) {
+    // every copy of a file shares one scene, loaded and uploaded once
+    const std::shared_ptr<LoadedGLTF> scene =
+            asset_cache.acquire(std::string(ASSETS_DIR) + filePath);
 
-    meshes[random_int64] = *structureFile;
-    transforms[random_int64] = glm::mat4(1.0f);
+    assert(scene != nullptr);
 
-    return random_int64;
+    const SlotHandle handle = mesh_slots.insert();
+    meshes.push_back(scene);
+    transforms.push_back(glm::mat4(1.0f));
+
+    return handle;
 }
 
-void VulkanEngine::unregisterMesh(int64_t id) {
-    if (meshes.find(id) != meshes.end()) {
-        meshes.erase(id);
-        transforms.erase(id);
+void VulkanEngine::unregisterMesh(SlotHandle handle) {
+    const std::optional<uint32_t> index = mesh_slots.erase(handle);
+    if (!index) {
+        return;
     }
+
+    asset_cache.release(meshes[*index]);
+
+    // mirror the slot map, the last mesh fills the hole
+    meshes[*index] = std::move(meshes.back());
+    meshes.pop_back();
+    transforms[*index] = transforms.back();
+    transforms.pop_back();
 }
 
-void VulkanEngine::setMeshTransform(int64_t id, glm::mat4 mat) {
-    transforms[id] = mat;
+void VulkanEngine::setMeshTransform(SlotHandle handle, glm::mat4 mat) {
+    if (const std::optional<uint32_t> index = mesh_slots.dense_index(handle)) {
+        transforms[*index] = mat;
+    }
 }
@@ -0,0 +1,357 @@
+#include "graphics/vulkan/vk_geometry_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iterator>
+
+#include "core/Logging.h"
+#include "graphics/vulkan/vk_engine.h"
+
+// Vertex holds vec4s, buffer references need their base aligned to them
+constexpr VkDeviceSize VERTEX_ALIGNMENT = 16;
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void RangeAllocator::init(uint64_t capacity) {
+    _free.clear();
+    _capacity = capacity;
+    _used = 0;
+    if (capacity > 0) {
+        _free[0] = capacity;
+    }
+}
+
+std::optional<uint64_t> RangeAllocator::allocate(uint64_t size,
+                                                 uint64_t alignment) {
+    for (auto it = _free.begin(); it != _free.end(); ++it) {
+        const uint64_t blockOffset = it->first;
+        const uint64_t blockEnd = blockOffset + it->second;
+        const uint64_t offset = align_up(blockOffset, alignment);
+        if (offset + size > blockEnd) {
+            continue;
+        }
+
+        // the padding in front and the tail stay free
+        _free.erase(it);
+        if (offset > blockOffset) {
+            _free[blockOffset] = offset - blockOffset;
+        }
+        if (offset + size < blockEnd) {
+            _free[offset + size] = blockEnd - offset - size;
+        }
+        _used += size;
+        return offset;
+    }
+    return std::nullopt;
+}
+
+void RangeAllocator::free(uint64_t offset, uint64_t size) {
+    assert(_used >= size);
+    _used -= size;
+
+    uint64_t start = offset;
+    uint64_t end = offset + size;
+
+    auto next = _free.lower_bound(offset);
+    if (next != _free.end() && next->first == end) {
+        end += next->second;
+        next = _free.erase(next);
+    }
+    if (next != _free.begin()) {
+        const auto prev = std::prev(next);
+        if (prev->first + prev->second == start) {
+            start = prev->first;
+            _free.erase(prev);
+        }
+    }
+    _free[start] = end - start;
+}
+
+void RangeAllocator::grow(uint64_t capacity) {
+    assert(capacity >= _capacity);
+    const uint64_t added = capacity - _capacity;
+    _capacity = capacity;
+    if (added > 0) {
+        // accounted as used so free() can merge it like any other range
+        _used += added;
+        free(capacity - added, added);
+    }
+}
+
+uint64_t RangeAllocator::extent() const {
+    if (!_free.empty()) {
+        const auto& [offset, size] = *_free.rbegin();
+        if (offset + size == _capacity) {
+            return offset;
+        }
+    }
+    return _capacity;
+}
+
+void GeometryBuffer::init(VulkanEngine* vk_engine,
+                          VkDeviceSize vertexCapacity,
+                          uint32_t indexCapacity) {
+    _engine = vk_engine;
+
+    vertexCapacity = align_up(vertexCapacity, VERTEX_ALIGNMENT);
+    rebuild(vertexCapacity, indexCapacity, {}, {});
+    _vertexRanges.init(vertexCapacity);
+    _indexRanges.init(indexCapacity);
+    _allocations.clear();
+}
+
+void GeometryBuffer::cleanup() {
+    for (const Rebuild& rebuild : _rebuilds) {
+        _engine->destroy_buffer(rebuild.oldVertexBuffer);
+        _engine->destroy_buffer(rebuild.oldIndexBuffer);
+    }
+    _rebuilds.clear();
+
+    if (_vertexBuffer.buffer != VK_NULL_HANDLE) {
+        _engine->destroy_buffer(_vertexBuffer);
+        _engine->destroy_buffer(_indexBuffer);
+        _vertexBuffer = {};
+        _indexBuffer = {};
+        _vertexAddress = 0;
+    }
+    _allocations.clear();
+}
+
+GeometryAllocation GeometryBuffer::allocate(VkDeviceSize vertexSize,
+                                            uint32_t indexCount) {
+    // empty ranges still get a unit so every allocation has its own offsets
+    const VkDeviceSize vertexBytes =
+            align_up(std::max<VkDeviceSize>(vertexSize, 1), VERTEX_ALIGNMENT);
+    const uint32_t indices = std::max(indexCount, 1u);
+
+    std::optional<uint64_t> vertexOffset =
+            _vertexRanges.allocate(vertexBytes, VERTEX_ALIGNMENT);
+    std::optional<uint64_t> firstIndex = _indexRanges.allocate(indices, 1);
+
+    if (!vertexOffset || !firstIndex) {
+        if (vertexOffset) {
+            _vertexRanges.free(*vertexOffset, vertexBytes);
+        }
+        if (firstIndex) {
+            _indexRanges.free(*firstIndex, indices);
+        }
+
+        // at least double, the new space alone always fits the request
+        VkDeviceSize vertexCapacity = _vertexRanges.capacity();
+        if (!vertexOffset) {
+            vertexCapacity = std::max(vertexCapacity * 2,
+                                      vertexCapacity + vertexBytes);
+        }
+        uint64_t indexCapacity = _indexRanges.capacity();
+        if (!firstIndex) {
+            indexCapacity = std::max(indexCapacity * 2, indexCapacity + indices);
+        }
+
+        // a whole buffer copy keeps every offset valid
+        rebuild(vertexCapacity, static_cast<uint32_t>(indexCapacity),
+                {{0, 0, _vertexRanges.extent()}},
+                {{0, 0, _indexRanges.extent() * sizeof(uint32_t)}});
+        _vertexRanges.grow(vertexCapacity);
+        _indexRanges.grow(indexCapacity);
+        LOGI("Geometry buffers grown to {} MB of vertices and {} indices",
+             vertexCapacity >> 20, indexCapacity);
+
+        vertexOffset = _vertexRanges.allocate(vertexBytes, VERTEX_ALIGNMENT);
+        firstIndex = _indexRanges.allocate(indices, 1);
+        assert(vertexOffset && firstIndex);
+    }
+
+    GeometryAllocation allocation{};
+    allocation.vertexOffset = *vertexOffset;
+    allocation.vertexSize = vertexBytes;
+    allocation.firstIndex = static_cast<uint32_t>(*firstIndex);
+    allocation.indexCount = indexCount;
+    _allocations[allocation.vertexOffset] = allocation;
+    return allocation;
+}
+
+void GeometryBuffer::free(const GeometryAllocation& allocation) {
+    if (_allocations.erase(allocation.vertexOffset) == 0) {
+        return;
+    }
+    _vertexRanges.free(allocation.vertexOffset, allocation.vertexSize);
+    _indexRanges.free(allocation.firstIndex,
+                      std::max(allocation.indexCount, 1u));
+}
+
+GeometryBuffer::DefragmentPlan GeometryBuffer::plan_defragment(
+        const std::map<VkDeviceSize, GeometryAllocation>& allocations,
+        VkDeviceSize vertexCapacity, uint64_t indexCapacity) {
+    DefragmentPlan plan;
+
+    // allocating in the old order from empty allocators packs the ranges
+    // without holes, each buffer in its own order
+    std::vector<GeometryMove>& moves = plan.moves;
+    moves.reserve(allocations.size());
+    for (const auto& [offset, allocation] : allocations) {
+        moves.push_back({allocation, allocation});
+    }
+
+    plan.vertexRanges.init(vertexCapacity);
+    for (GeometryMove& move : moves) {
+        move.to.vertexOffset = *plan.vertexRanges.allocate(move.from.vertexSize,
+                                                           VERTEX_ALIGNMENT);
+        plan.vertexCopies.push_back({move.from.vertexOffset,
+                                     move.to.vertexOffset,
+                                     move.from.vertexSize});
+    }
+
+    std::vector<GeometryMove*> indexOrder;
+    for (GeometryMove& move : moves) {
+        indexOrder.push_back(&move);
+    }
+    std::ranges::sort(indexOrder, {}, [](const GeometryMove* move) {
+        return move->from.firstIndex;
+    });
+
+    plan.indexRanges.init(indexCapacity);
+    for (GeometryMove* move : indexOrder) {
+        const uint32_t indices = std::max(move->from.indexCount, 1u);
+        move->to.firstIndex =
+                static_cast<uint32_t>(*plan.indexRanges.allocate(indices, 1));
+        plan.indexCopies.push_back({move->from.firstIndex * sizeof(uint32_t),
+                                    move->to.firstIndex * sizeof(uint32_t),
+                                    indices * sizeof(uint32_t)});
+    }
+    return plan;
+}
+
+std::vector<GeometryMove> GeometryBuffer::defragment() {
+    if (fragmentation() == 0.f) {
+        return {};
+    }
+
+    DefragmentPlan plan = plan_defragment(
+            _allocations, _vertexRanges.capacity(), _indexRanges.capacity());
+
+    rebuild(_vertexRanges.capacity(),
+            static_cast<uint32_t>(_indexRanges.capacity()),
+            std::move(plan.vertexCopies), std::move(plan.indexCopies));
+    _vertexRanges = plan.vertexRanges;
+    _indexRanges = plan.indexRanges;
+
+    std::vector<GeometryMove> moves = std::move(plan.moves);
+    _allocations.clear();
+    for (const GeometryMove& move : moves) {
+        _allocations[move.to.vertexOffset] = move.to;
+    }
+
+    std::erase_if(moves, [](const GeometryMove& move) {
+        return move.from.vertexOffset == move.to.vertexOffset &&
+               move.from.firstIndex == move.to.firstIndex;
+    });
+    return moves;
+}
+
+float GeometryBuffer::fragmentation() const {
+    const auto holes = [](const RangeAllocator& ranges) {
+        const uint64_t extent = ranges.extent();
+        return extent == 0 ? 0.f
+                           : 1.f - static_cast<float>(ranges.used()) /
+                                           static_cast<float>(extent);
+    };
+    return std::max(holes(_vertexRanges), holes(_indexRanges));
+}
+
+void GeometryBuffer::rebuild(VkDeviceSize vertexCapacity,
+                             uint32_t indexCapacity,
+                             std::vector<Copy> vertexCopies,
+                             std::vector<Copy> indexCopies) {
+    // uploads write into the buffers while frames read other meshes, so the
+    // transfer family never takes ownership of them
+    const AllocatedBuffer vertexBuffer = _engine->create_shared_buffer(
+            vertexCapacity,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+    const AllocatedBuffer indexBuffer = _engine->create_shared_buffer(
+            static_cast<VkDeviceSize>(indexCapacity) * sizeof(uint32_t),
+            VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                    VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VMA_MEMORY_USAGE_GPU_ONLY);
+
+    // frames in flight and pending uploads keep the old buffers until the
+    // next frame copies them over
+    if (_vertexBuffer.buffer != VK_NULL_HANDLE) {
+        _rebuilds.push_back({_vertexBuffer, _indexBuffer, vertexBuffer.buffer,
+                             indexBuffer.buffer, std::move(vertexCopies),
+                             std::move(indexCopies)});
+    }
+
+    _vertexBuffer = vertexBuffer;
+    _indexBuffer = indexBuffer;
+
+    const VkBufferDeviceAddressInfo deviceAddressInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = _vertexBuffer.buffer};
+    _vertexAddress =
+            vkGetBufferDeviceAddress(_engine->_device, &deviceAddressInfo);
+}
+
+static void memory_barrier(VkCommandBuffer cmd, VkPipelineStageFlags2 srcStage,
+                           VkAccessFlags2 srcAccess,
+                           VkPipelineStageFlags2 dstStage,
+                           VkAccessFlags2 dstAccess) {
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask = srcStage;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstStageMask = dstStage;
+    barrier.dstAccessMask = dstAccess;
+    VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    depInfo.memoryBarrierCount = 1;
+    depInfo.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void GeometryBuffer::record_rebuilds(VkCommandBuffer cmd) {
+    if (_rebuilds.empty()) {
+        return;
+    }
+
+    const auto copy = [&](VkBuffer src, VkBuffer dst,
+                          const std::vector<Copy>& copies) {
+        std::vector<VkBufferCopy> regions;
+        for (const Copy& c : copies) {
+            if (c.size > 0) {
+                regions.push_back({c.srcOffset, c.dstOffset, c.size});
+            }
+        }
+        if (!regions.empty()) {
+            vkCmdCopyBuffer(cmd, src, dst,
+                            static_cast<uint32_t>(regions.size()),
+                            regions.data());
+        }
+    };
+
+    // chains behind the transfer semaphore wait of this submission and the
+    // uploads earlier submissions waited for
+    memory_barrier(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                   VK_ACCESS_2_MEMORY_WRITE_BIT, VK_PIPELINE_STAGE_2_COPY_BIT,
+                   VK_ACCESS_2_TRANSFER_READ_BIT);
+
+    // a buffer replaced twice is the source of the second copy
+    for (const Rebuild& rebuild : _rebuilds) {
+        copy(rebuild.oldVertexBuffer.buffer, rebuild.vertexBuffer,
+             rebuild.vertexCopies);
+        copy(rebuild.oldIndexBuffer.buffer, rebuild.indexBuffer,
+             rebuild.indexCopies);
+        memory_barrier(cmd, VK_PIPELINE_STAGE_2_COPY_BIT,
+                       VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                       VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT,
+                       VK_ACCESS_2_MEMORY_READ_BIT);
+
+        _engine->retire_buffer(rebuild.oldVertexBuffer);
+        _engine->retire_buffer(rebuild.oldIndexBuffer);
+    }
+    _rebuilds.clear();
+}
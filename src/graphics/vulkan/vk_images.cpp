@@ -1,5 +1,7 @@
 #include "graphics/vulkan/vk_images.h"
 
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 
 #include "graphics/vulkan/vk_initializers.h"
@@ -20,8 +22,12 @@ void vkutil::transition_image(VkCommandBuffer cmd, VkImage image,
     imageBarrier.oldLayout = currentLayout;
     imageBarrier.newLayout = newLayout;
 
+    auto isDepthLayout = [](VkImageLayout layout) {
+        return layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+               layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    };
     const auto aspectMask = static_cast<VkImageAspectFlags>(
-            (newLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL)
+            (isDepthLayout(newLayout) || isDepthLayout(currentLayout))
                     ? VK_IMAGE_ASPECT_DEPTH_BIT
                     : VK_IMAGE_ASPECT_COLOR_BIT);
     imageBarrier.subresourceRange = vkinit::image_subresource_range(aspectMask);
@@ -72,4 +78,116 @@ void vkutil::copy_image_to_image(VkCommandBuffer cmd, VkImage source,
     blitInfo.pRegions = &blitRegion;
 
     vkCmdBlitImage2(cmd, &blitInfo);
+}
+
+uint32_t vkutil::format_texel_size(VkFormat format) {
+    switch (format) {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R8G8_SRGB:
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_R16_UNORM:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+uint32_t vkutil::mip_count(VkExtent2D size) {
+    return std::bit_width(std::max({size.width, size.height, 1u}));
+}
+
+// barrier on a range of mips of a color image
+static void mip_barrier(VkCommandBuffer cmd, VkImage image, uint32_t baseMip,
+                        uint32_t mipCount, VkImageLayout oldLayout,
+                        VkImageLayout newLayout, VkPipelineStageFlags2 srcStage,
+                        VkAccessFlags2 srcAccess, VkPipelineStageFlags2 dstStage,
+                        VkAccessFlags2 dstAccess) {
+    VkImageMemoryBarrier2 imageBarrier{
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    imageBarrier.srcStageMask = srcStage;
+    imageBarrier.srcAccessMask = srcAccess;
+    imageBarrier.dstStageMask = dstStage;
+    imageBarrier.dstAccessMask = dstAccess;
+    imageBarrier.oldLayout = oldLayout;
+    imageBarrier.newLayout = newLayout;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange =
+            vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+    imageBarrier.subresourceRange.baseMipLevel = baseMip;
+    imageBarrier.subresourceRange.levelCount = mipCount;
+
+    VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    depInfo.imageMemoryBarrierCount = 1;
+    depInfo.pImageMemoryBarriers = &imageBarrier;
+    vkCmdPipelineBarrier2(cmd, &depInfo);
+}
+
+void vkutil::generate_mipmaps(VkCommandBuffer cmd, VkImage image,
+                              VkExtent2D size, uint32_t mipLevels) {
+    for (uint32_t mip = 0; mip + 1 < mipLevels; mip++) {
+        const VkExtent2D half{std::max(size.width / 2, 1u),
+                              std::max(size.height / 2, 1u)};
+
+        // the level was written by the copy or the previous blit
+        mip_barrier(cmd, image, mip, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT,
+                    VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                    VK_PIPELINE_STAGE_2_BLIT_BIT,
+                    VK_ACCESS_2_TRANSFER_READ_BIT);
+
+        VkImageBlit2 blitRegion{.sType = VK_STRUCTURE_TYPE_IMAGE_BLIT_2};
+        blitRegion.srcOffsets[1] = {static_cast<int32_t>(size.width),
+                                    static_cast<int32_t>(size.height), 1};
+        blitRegion.dstOffsets[1] = {static_cast<int32_t>(half.width),
+                                    static_cast<int32_t>(half.height), 1};
+        blitRegion.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip, 0, 1};
+        blitRegion.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, mip + 1, 0, 1};
+
+        VkBlitImageInfo2 blitInfo{.sType = VK_STRUCTURE_TYPE_BLIT_IMAGE_INFO_2};
+        blitInfo.srcImage = image;
+        blitInfo.srcImageLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        blitInfo.dstImage = image;
+        blitInfo.dstImageLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        blitInfo.filter = VK_FILTER_LINEAR;
+        blitInfo.regionCount = 1;
+        blitInfo.pRegions = &blitRegion;
+        vkCmdBlitImage2(cmd, &blitInfo);
+
+        size = half;
+    }
+
+    // the levels above the last one were read, the last one written
+    if (mipLevels > 1) {
+        mip_barrier(cmd, image, 0, mipLevels - 1,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                    VK_PIPELINE_STAGE_2_BLIT_BIT, VK_ACCESS_2_NONE,
+                    VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                    VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    }
+    mip_barrier(cmd, image, mipLevels - 1, 1,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_BLIT_BIT,
+                VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT,
+                VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
 }
\ No newline at end of file
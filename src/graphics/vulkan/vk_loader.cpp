@@ -1,6 +1,7 @@
 ﻿#include "graphics/vulkan/vk_loader.h"
 
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <cstring>
 #include <fastgltf/core.hpp>
@@ -8,6 +9,7 @@
 #include <fastgltf/tools.hpp>
 #include <fastgltf/types.hpp>
 #include <fastgltf/util.hpp>
+#include <algorithm>
 #include <fmt/base.h>
 #include <vk_mem_alloc.h>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -23,10 +25,96 @@
 #include <utility>
 #include <variant>
 
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
 #include "graphics/vulkan/vk_descriptors.h"
 #include "graphics/vulkan/vk_engine.h"
+#include "graphics/vulkan/vk_images.h"
+#include "graphics/vulkan/vk_mesh_optimizer.h"
 #include "graphics/vulkan/vk_types.h"
 
+// box and enclosing sphere around the box center, both in object space
+static Bounds compute_bounds(std::span<const Vertex> vertices) {
+    if (vertices.empty()) {
+        return {};
+    }
+
+    glm::vec3 minpos = vertices[0].position;
+    glm::vec3 maxpos = vertices[0].position;
+    for (const Vertex& vertex : vertices) {
+        minpos = glm::min(minpos, vertex.position);
+        maxpos = glm::max(maxpos, vertex.position);
+    }
+
+    Bounds bounds{};
+    bounds.origin = (maxpos + minpos) / 2.f;
+    bounds.extents = (maxpos - minpos) / 2.f;
+    bounds.sphereRadius = glm::length(bounds.extents);
+    return bounds;
+}
+
+// triangle weighted ACMR of every mesh of a file
+struct OptimizeReport {
+    double acmrBefore{0.};
+    double acmrAfter{0.};
+    size_t triangles{0};
+};
+
+// the optional optimization stages between accessor decoding and upload
+static void optimize_mesh(const VulkanEngine* engine, MeshAsset& mesh,
+                          std::vector<uint32_t>& indices,
+                          std::vector<Vertex>& vertices,
+                          OptimizeReport& report) {
+    if (engine->_config.optimizeMeshes) {
+        const MeshOptimizeStats stats =
+                vkutil::optimize_mesh(mesh.surfaces, indices, vertices);
+        const size_t triangles = indices.size() / 3;
+        report.acmrBefore += stats.acmrBefore * triangles;
+        report.acmrAfter += stats.acmrAfter * triangles;
+        report.triangles += triangles;
+    }
+
+    // after the reordering, which only knows the full index ranges
+    if (engine->_config.generateLods) {
+        vkutil::generate_lods(mesh.surfaces, indices, vertices);
+    }
+}
+
+// uploads the geometry, plus the meshlets of the full surfaces when the
+// device can draw them. Afterwards the surfaces index the shared index
+// buffer instead of the mesh's own indices
+static void upload_mesh(VulkanEngine* engine, MeshAsset& mesh,
+                        std::vector<uint32_t>& indices,
+                        std::vector<Vertex>& vertices) {
+    // meshlets read the mesh-local ranges
+    MeshletData meshlets;
+    if (engine->_meshShaderSupported) {
+        meshlets = vkutil::build_meshlets(mesh.surfaces, indices, vertices);
+    }
+
+    mesh.meshBuffers = engine->uploadMesh(indices, vertices);
+    engine->upload_meshlets(meshlets, mesh.meshBuffers);
+
+    const uint32_t firstIndex = mesh.meshBuffers.geometry.firstIndex;
+    for (GeoSurface& surface : mesh.surfaces) {
+        surface.startIndex += firstIndex;
+        for (SurfaceLod& lod : surface.lods) {
+            lod.startIndex += firstIndex;
+        }
+    }
+}
+
+static void print_report(std::string_view filePath,
+                         const OptimizeReport& report) {
+    if (report.triangles == 0) {
+        return;
+    }
+    fmt::println("{}: {} triangles, ACMR {:.3f} -> {:.3f}", filePath,
+                 report.triangles, report.acmrBefore / report.triangles,
+                 report.acmrAfter / report.triangles);
+}
+
 std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(
         VulkanEngine* engine, const std::filesystem::path& filePath) {
     if (!std::filesystem::exists(filePath)) {
@@ -75,6 +163,7 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(
     // as often
     std::vector<uint32_t> indices;
     std::vector<Vertex> vertices;
+    OptimizeReport report;
     for (auto& [primitives, _, name] : gltf.meshes) {
         MeshAsset newmesh;
 
@@ -152,6 +241,8 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(
                             vertices[initial_vtx + index].color = v;
                         });
             }
+            newSurface.bounds = compute_bounds(std::span(vertices).subspan(
+                    initial_vtx, vertices.size() - initial_vtx));
             newmesh.surfaces.push_back(newSurface);
         }
 
@@ -162,10 +253,12 @@ std::optional<std::vector<std::shared_ptr<MeshAsset>>> loadGltfMeshes(
                 vtx.color = glm::vec4(vtx.normal, 1.f);
             }
         }
-        newmesh.meshBuffers = engine->uploadMesh(indices, vertices);
+        optimize_mesh(engine, newmesh, indices, vertices, report);
+        upload_mesh(engine, newmesh, indices, vertices);
 
         meshes.emplace_back(std::make_shared<MeshAsset>(std::move(newmesh)));
     }
+    print_report(filePath.string(), report);
 
     return meshes;
 }
@@ -200,6 +293,216 @@ VkSamplerMipmapMode extract_mipmap_mode(fastgltf::Filter filter) {
     }
 }
 
+// where the encoded bytes of a glTF image are, a file on disk or memory
+// owned by the asset
+struct ImageSource {
+    std::filesystem::path file;
+    const stbi_uc* bytes{nullptr};
+    size_t size{0};
+};
+
+static std::optional<ImageSource> image_source(
+        const fastgltf::Asset& gltf, const fastgltf::Image& image,
+        const std::filesystem::path& directory) {
+    std::optional<ImageSource> source;
+    const auto memory = [&](const auto& bytes, size_t offset, size_t size) {
+        source = ImageSource{
+                {}, reinterpret_cast<const stbi_uc*>(bytes.data()) + offset,
+                size};
+    };
+
+    std::visit(
+            fastgltf::visitor{
+                    [](const auto&) {},
+                    [&](const fastgltf::sources::URI& uri) {
+                        if (uri.fileByteOffset == 0 && uri.uri.isLocalPath()) {
+                            source = ImageSource{
+                                    directory / std::string(uri.uri.path())};
+                        }
+                    },
+                    [&](const fastgltf::sources::Vector& vector) {
+                        memory(vector.bytes, 0, vector.bytes.size());
+                    },
+                    [&](const fastgltf::sources::BufferView& view) {
+                        const fastgltf::BufferView& bufferView =
+                                gltf.bufferViews[view.bufferViewIndex];
+                        const fastgltf::Buffer& buffer =
+                                gltf.buffers[bufferView.bufferIndex];
+                        std::visit(
+                                fastgltf::visitor{
+                                        [](const auto&) {},
+                                        [&](const fastgltf::sources::Vector&
+                                                    vector) {
+                                            memory(vector.bytes,
+                                                   bufferView.byteOffset,
+                                                   bufferView.byteLength);
+                                        },
+                                        [&](const fastgltf::sources::ByteView&
+                                                    byteView) {
+                                            memory(byteView.bytes,
+                                                   bufferView.byteOffset,
+                                                   bufferView.byteLength);
+                                        }},
+                                buffer.data);
+                    }},
+            image.data);
+
+    return source;
+}
+
+// Decodes every image of the file on the worker pool and uploads them in one
+// transfer submission. The headers are read first to size one shared
+// staging buffer; each worker copies its decoded pixels into the image's
+// slice, stb_image has no way to decode into caller memory. Images that fail
+// to decode are nullopt
+static std::vector<std::optional<AllocatedImage>> load_images(
+        VulkanEngine* engine, const fastgltf::Asset& gltf,
+        const std::filesystem::path& directory) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto count = static_cast<uint32_t>(gltf.images.size());
+
+    struct Decode {
+        std::optional<ImageSource> source;
+        int width{0};
+        int height{0};
+        VkDeviceSize offset{0};
+        bool decoded{false};
+    };
+    std::vector<Decode> decodes(count);
+
+    engine->_workerPool->parallelFor(count, [&](uint32_t i) {
+        Decode& decode = decodes[i];
+        decode.source = image_source(gltf, gltf.images[i], directory);
+        if (!decode.source) {
+            return;
+        }
+
+        int channels = 0;
+        const int ok =
+                decode.source->bytes != nullptr
+                        ? stbi_info_from_memory(
+                                  decode.source->bytes,
+                                  static_cast<int>(decode.source->size),
+                                  &decode.width, &decode.height, &channels)
+                        : stbi_info(decode.source->file.string().c_str(),
+                                    &decode.width, &decode.height, &channels);
+        if (!ok) {
+            decode.width = 0;
+            decode.height = 0;
+        }
+    });
+
+    // RGBA8 slices, copy offsets must be a multiple of the texel size
+    VkDeviceSize stagingSize = 0;
+    for (Decode& decode : decodes) {
+        decode.offset = stagingSize;
+        stagingSize += static_cast<VkDeviceSize>(decode.width) *
+                       static_cast<VkDeviceSize>(decode.height) * 4;
+    }
+
+    std::vector<std::optional<AllocatedImage>> images(count);
+    if (stagingSize == 0) {
+        return images;
+    }
+
+    const AllocatedBuffer staging =
+            engine->create_buffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                  VMA_MEMORY_USAGE_CPU_ONLY);
+    auto* stagingData =
+            static_cast<stbi_uc*>(staging.allocation->GetMappedData());
+
+    engine->_workerPool->parallelFor(count, [&](uint32_t i) {
+        Decode& decode = decodes[i];
+        if (decode.width == 0 || decode.height == 0) {
+            return;
+        }
+
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        stbi_uc* pixels =
+                decode.source->bytes != nullptr
+                        ? stbi_load_from_memory(
+                                  decode.source->bytes,
+                                  static_cast<int>(decode.source->size), &width,
+                                  &height, &channels, 4)
+                        : stbi_load(decode.source->file.string().c_str(),
+                                    &width, &height, &channels, 4);
+        // the file may have changed since its header was read
+        if (pixels != nullptr && width == decode.width &&
+            height == decode.height) {
+            memcpy(stagingData + decode.offset, pixels,
+                   static_cast<size_t>(width) * height * 4);
+            decode.decoded = true;
+        }
+        stbi_image_free(pixels);
+    });
+
+    // glTF stores base color and emissive textures in sRGB, metal-rough,
+    // normal and occlusion textures as linear data. An image used both ways
+    // is taken as color
+    std::vector<uint8_t> srgb(count, 0);
+    const auto markSrgb = [&](const auto& textureInfo) {
+        if (!textureInfo.has_value()) {
+            return;
+        }
+        const auto& imageIndex =
+                gltf.textures[textureInfo.value().textureIndex].imageIndex;
+        if (imageIndex.has_value() && imageIndex.value() < count) {
+            srgb[imageIndex.value()] = 1;
+        }
+    };
+    for (const fastgltf::Material& material : gltf.materials) {
+        markSrgb(material.pbrData.baseColorTexture);
+        markSrgb(material.emissiveTexture);
+    }
+
+    // the mip chains are blitted on the GPU after the copies
+    const bool mipmappedUnorm =
+            engine->supports_mip_generation(VK_FORMAT_R8G8B8A8_UNORM);
+    const bool mipmappedSrgb =
+            engine->supports_mip_generation(VK_FORMAT_R8G8B8A8_SRGB);
+
+    std::vector<ImageUpload> uploads;
+    for (uint32_t i = 0; i < count; i++) {
+        const Decode& decode = decodes[i];
+        if (!decode.decoded) {
+            fmt::println("Failed to decode image {} '{}'", i,
+                         gltf.images[i].name.c_str());
+            continue;
+        }
+
+        const VkExtent3D extent{static_cast<uint32_t>(decode.width),
+                                static_cast<uint32_t>(decode.height), 1};
+        const VkFormat format = srgb[i] ? VK_FORMAT_R8G8B8A8_SRGB
+                                        : VK_FORMAT_R8G8B8A8_UNORM;
+        const bool mipmapped = srgb[i] ? mipmappedSrgb : mipmappedUnorm;
+        images[i] = engine->create_image(
+                extent, format,
+                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                        VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                mipmapped);
+        const uint32_t mipLevels =
+                mipmapped ? vkutil::mip_count({extent.width, extent.height})
+                          : 1;
+        uploads.push_back({images[i]->image, decode.offset, extent, mipLevels});
+    }
+
+    if (uploads.empty()) {
+        engine->destroy_buffer(staging);
+        return images;
+    }
+    // the transfer queue frees the staging buffer once the copies are done
+    engine->transfer_queue.upload_images(staging, uploads);
+
+    const std::chrono::duration<float, std::milli> elapsed =
+            std::chrono::steady_clock::now() - start;
+    fmt::println("Decoded {} images ({} MB) in {:.1f} ms on {} threads",
+                 uploads.size(), stagingSize >> 20, elapsed.count(),
+                 engine->_workerPool->size() + 1);
+    return images;
+}
+
 std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
                                                     std::string_view filePath) {
     fmt::print("Loading GLTF: {}", filePath);
@@ -240,16 +543,6 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         return {};
     }
 
-    // Estimate descriptor pool size based on materials
-    std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
-            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
-            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
-            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}};
-    file.descriptorPool.init(
-            engine->_device,
-            static_cast<uint32_t>(std::max(gltf.materials.size(), size_t(1))),
-            sizes);
-
     // Load samplers
     for (fastgltf::Sampler& sampler : gltf.samplers) {
         VkSamplerCreateInfo sampl = {
@@ -273,23 +566,22 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
     std::vector<AllocatedImage> images;
     std::vector<std::shared_ptr<GLTFMaterial>> materials;
 
-    // Load all textures
+    // Load all textures, the checkerboard stands in for the ones that fail
+    std::vector<std::optional<AllocatedImage>> loadedImages =
+            load_images(engine, gltf, path.parent_path());
     images.reserve(gltf.images.size());
     for (size_t i = 0; i < gltf.images.size(); i++) {
-        images.push_back(engine->_errorCheckerboardImage->get());
+        if (!loadedImages[i]) {
+            images.push_back(engine->_errorCheckerboardImage->get());
+            continue;
+        }
+        images.push_back(*loadedImages[i]);
+        file.imageList.push_back(*loadedImages[i]);
+        if (!gltf.images[i].name.empty()) {
+            file.images[gltf.images[i].name.c_str()] = *loadedImages[i];
+        }
     }
 
-    // Create buffer to hold the material data
-    size_t materialCount = gltf.materials.size() ? gltf.materials.size() : 1;
-    file.materialDataBuffer = engine->create_buffer(
-            sizeof(GLTFMetallic_Roughness::MaterialConstants) * materialCount,
-            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    uint32_t data_index = 0;
-    auto* sceneMaterialConstants =
-            (GLTFMetallic_Roughness::MaterialConstants*)
-                    file.materialDataBuffer.info.pMappedData;
-
     // Process all materials from the GLTF
     for (fastgltf::Material& mat : gltf.materials) {
         auto newMat = std::make_shared<GLTFMaterial>();
@@ -304,8 +596,6 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         constants.metal_rough_factors.x = mat.pbrData.metallicFactor;
         constants.metal_rough_factors.y = mat.pbrData.roughnessFactor;
 
-        sceneMaterialConstants[data_index] = constants;
-
         auto passType = MaterialPass::MainColor;
         if (mat.alphaMode == fastgltf::AlphaMode::Blend) {
             passType = MaterialPass::Transparent;
@@ -318,9 +608,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         materialResources.colorSampler = engine->_defaultSamplerLinear;
         materialResources.metalRoughImage = engine->_whiteImage->get();
         materialResources.metalRoughSampler = engine->_defaultSamplerLinear;
-        materialResources.dataBuffer = file.materialDataBuffer.buffer;
-        materialResources.dataBufferOffset =
-                data_index * sizeof(GLTFMetallic_Roughness::MaterialConstants);
+        materialResources.constants = constants;
 
         if (mat.pbrData.baseColorTexture.has_value()) {
             size_t img = gltf.textures[mat.pbrData.baseColorTexture.value()
@@ -334,9 +622,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         }
 
         newMat->data = engine->metalRoughMaterial.write_material(
-                engine->_device, passType, materialResources,
-                file.descriptorPool);
-        data_index++;
+                passType, materialResources, engine->bindless_table);
     }
 
     // Add a fallback material if no materials were defined in the GLTF
@@ -348,23 +634,20 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         constants.colorFactors = glm::vec4(1.0f);  // White base color
         constants.metal_rough_factors = glm::vec4(0.0f);  // Non-metallic, smooth
 
-        sceneMaterialConstants[0] = constants;
-
         GLTFMetallic_Roughness::MaterialResources resources;
         resources.colorImage = engine->_whiteImage->get();
         resources.colorSampler = engine->_defaultSamplerLinear;
         resources.metalRoughImage = engine->_whiteImage->get();
         resources.metalRoughSampler = engine->_defaultSamplerLinear;
-        resources.dataBuffer = file.materialDataBuffer.buffer;
-        resources.dataBufferOffset = 0;
+        resources.constants = constants;
 
         defaultMat->data = engine->metalRoughMaterial.write_material(
-                engine->_device, MaterialPass::MainColor, resources,
-                file.descriptorPool);
+                MaterialPass::MainColor, resources, engine->bindless_table);
     }
 
     std::vector<uint32_t> indices;
     std::vector<Vertex> vertices;
+    OptimizeReport report;
 
     for (auto& [primitives, _, name] : gltf.meshes) {
         auto newmesh = std::make_shared<MeshAsset>();
@@ -447,10 +730,14 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
                 newSurface.material = materials[0];  // Always valid now
             }
 
+            newSurface.bounds = compute_bounds(std::span(vertices).subspan(
+                    initial_vtx, vertices.size() - initial_vtx));
             newmesh->surfaces.push_back(newSurface);
         }
-        newmesh->meshBuffers = engine->uploadMesh(indices, vertices);
+        optimize_mesh(engine, *newmesh, indices, vertices, report);
+        upload_mesh(engine, *newmesh, indices, vertices);
     }
+    print_report(filePath, report);
 
     // Load all nodes and their meshes
     for (fastgltf::Node& node : gltf.nodes) {
@@ -509,6 +796,9 @@ std::optional<std::shared_ptr<LoadedGLTF>> loadGltf(VulkanEngine* engine,
         }
     }
 
+    file.meshList = std::move(meshes);
+    file.materialList = std::move(materials);
+
     return scene;
 }
 
@@ -519,4 +809,30 @@ void LoadedGLTF::Draw(const glm::mat4& topMatrix, DrawContext& ctx) {
     }
 }
 
-void LoadedGLTF::clearAll() {}
+void LoadedGLTF::clearAll() {
+    if (creator == nullptr) {
+        return;
+    }
+
+    for (const auto& material : materialList) {
+        GLTFMetallic_Roughness::release_material(material->data,
+                                                 creator->bindless_table);
+    }
+    // the table no longer references the samplers once the materials are gone
+    for (VkSampler sampler : samplers) {
+        vkDestroySampler(creator->_device, sampler, nullptr);
+    }
+    for (const auto& mesh : meshList) {
+        creator->destroy_mesh_buffers(mesh->meshBuffers);
+    }
+    for (const AllocatedImage& image : imageList) {
+        creator->destroy_image(image);
+    }
+
+    meshList.clear();
+    materialList.clear();
+    imageList.clear();
+    images.clear();
+    samplers.clear();
+    creator = nullptr;
+}
@@ -0,0 +1,187 @@
+#include "graphics/vulkan/vk_mesh_optimizer.h"
+
+#include <meshoptimizer.h>
+
+#include "graphics/vulkan/vk_loader.h"
+
+namespace {
+// the post-transform cache model meshoptimizer reports against
+constexpr unsigned int CACHE_SIZE = 16;
+// overdraw ordering may worsen the cache ratio by up to this factor
+constexpr float OVERDRAW_THRESHOLD = 1.05f;
+
+// meshlet limits, the triangle count keeps the packed triangles of a full
+// meshlet a multiple of four bytes
+constexpr size_t MESHLET_MAX_VERTICES = 64;
+constexpr size_t MESHLET_MAX_TRIANGLES = 124;
+// how much meshlet building favours tight normal cones over fewer meshlets
+constexpr float MESHLET_CONE_WEIGHT = 0.25f;
+
+// simplified levels per surface, not counting the full one
+constexpr size_t MAX_LODS = 5;
+// a level that keeps more than this fraction of the triangles before it is
+// not worth a draw of its own
+constexpr float MIN_LOD_REDUCTION = 0.85f;
+// relative to the mesh extent, bounds how far a single level may deviate
+constexpr float MAX_LOD_ERROR = 0.1f;
+
+float acmr(std::span<const uint32_t> indices, size_t vertexCount) {
+    return meshopt_analyzeVertexCache(indices.data(), indices.size(),
+                                      vertexCount, CACHE_SIZE, 0, 0)
+            .acmr;
+}
+}  // namespace
+
+MeshOptimizeStats vkutil::optimize_mesh(std::span<const GeoSurface> surfaces,
+                                        std::vector<uint32_t>& indices,
+                                        std::vector<Vertex>& vertices) {
+    MeshOptimizeStats stats{};
+    if (indices.empty() || vertices.empty()) {
+        return stats;
+    }
+
+    stats.acmrBefore = acmr(indices, vertices.size());
+
+    // triangles never move between surfaces, each one keeps its material
+    std::vector<uint32_t> scratch;
+    for (const GeoSurface& surface : surfaces) {
+        const std::span<uint32_t> range =
+                std::span(indices).subspan(surface.startIndex, surface.count);
+        scratch.resize(range.size());
+
+        meshopt_optimizeVertexCache(scratch.data(), range.data(), range.size(),
+                                    vertices.size());
+        meshopt_optimizeOverdraw(range.data(), scratch.data(), range.size(),
+                                 &vertices[0].position.x, vertices.size(),
+                                 sizeof(Vertex), OVERDRAW_THRESHOLD);
+    }
+
+    // remaps the indices in place, vertices no index uses are dropped
+    const size_t vertexCount = meshopt_optimizeVertexFetch(
+            vertices.data(), indices.data(), indices.size(), vertices.data(),
+            vertices.size(), sizeof(Vertex));
+    vertices.resize(vertexCount);
+
+    stats.acmrAfter = acmr(indices, vertices.size());
+    return stats;
+}
+
+void vkutil::generate_lods(std::span<GeoSurface> surfaces,
+                           std::vector<uint32_t>& indices,
+                           std::span<const Vertex> vertices) {
+    if (vertices.empty()) {
+        return;
+    }
+
+    // meshoptimizer reports errors relative to the mesh extent
+    const float errorScale = meshopt_simplifyScale(
+            &vertices[0].position.x, vertices.size(), sizeof(Vertex));
+
+    std::vector<uint32_t> source;
+    std::vector<uint32_t> simplified;
+    for (GeoSurface& surface : surfaces) {
+        surface.lods.clear();
+        source.assign(indices.begin() + surface.startIndex,
+                      indices.begin() + surface.startIndex + surface.count);
+
+        // each level simplifies the previous one, so errors add up
+        float error = 0.f;
+        while (surface.lods.size() < MAX_LODS) {
+            const size_t target = source.size() / 6 * 3;
+            simplified.resize(source.size());
+
+            float levelError = 0.f;
+            const size_t count = meshopt_simplify(
+                    simplified.data(), source.data(), source.size(),
+                    &vertices[0].position.x, vertices.size(), sizeof(Vertex),
+                    target, MAX_LOD_ERROR, meshopt_SimplifyLockBorder,
+                    &levelError);
+            if (count == 0 ||
+                count > source.size() * MIN_LOD_REDUCTION) {
+                break;
+            }
+            simplified.resize(count);
+            meshopt_optimizeVertexCache(simplified.data(), simplified.data(),
+                                        count, vertices.size());
+
+            error += levelError * errorScale;
+            surface.lods.push_back({static_cast<uint32_t>(indices.size()),
+                                    static_cast<uint32_t>(count), error});
+            indices.insert(indices.end(), simplified.begin(),
+                           simplified.end());
+            source.swap(simplified);
+        }
+    }
+}
+
+MeshletData vkutil::build_meshlets(std::span<GeoSurface> surfaces,
+                                   std::span<const uint32_t> indices,
+                                   std::span<const Vertex> vertices) {
+    MeshletData data;
+    if (vertices.empty()) {
+        return data;
+    }
+
+    std::vector<meshopt_Meshlet> meshlets;
+    std::vector<unsigned int> meshletVertices;
+    std::vector<unsigned char> meshletTriangles;
+    for (GeoSurface& surface : surfaces) {
+        const std::span<const uint32_t> range =
+                indices.subspan(surface.startIndex, surface.count);
+
+        const size_t maxMeshlets = meshopt_buildMeshletsBound(
+                range.size(), MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+        meshlets.resize(maxMeshlets);
+        meshletVertices.resize(maxMeshlets * MESHLET_MAX_VERTICES);
+        meshletTriangles.resize(maxMeshlets * MESHLET_MAX_TRIANGLES * 3);
+
+        const size_t count = meshopt_buildMeshlets(
+                meshlets.data(), meshletVertices.data(),
+                meshletTriangles.data(), range.data(), range.size(),
+                &vertices[0].position.x, vertices.size(), sizeof(Vertex),
+                MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES,
+                MESHLET_CONE_WEIGHT);
+
+        surface.firstMeshlet = static_cast<uint32_t>(data.meshlets.size());
+        surface.meshletCount = static_cast<uint32_t>(count);
+
+        const auto vertexBase = static_cast<uint32_t>(data.vertices.size());
+        const auto triangleBase = static_cast<uint32_t>(data.triangles.size());
+        for (size_t i = 0; i < count; i++) {
+            const meshopt_Meshlet& m = meshlets[i];
+            const meshopt_Bounds bounds = meshopt_computeMeshletBounds(
+                    &meshletVertices[m.vertex_offset],
+                    &meshletTriangles[m.triangle_offset], m.triangle_count,
+                    &vertices[0].position.x, vertices.size(), sizeof(Vertex));
+
+            GPUMeshlet meshlet{};
+            meshlet.boundingSphere = {bounds.center[0], bounds.center[1],
+                                      bounds.center[2], bounds.radius};
+            meshlet.coneApex = {bounds.cone_apex[0], bounds.cone_apex[1],
+                                bounds.cone_apex[2], 0.f};
+            meshlet.coneAxis = {bounds.cone_axis[0], bounds.cone_axis[1],
+                                bounds.cone_axis[2], bounds.cone_cutoff};
+            meshlet.vertexOffset = vertexBase + m.vertex_offset;
+            meshlet.triangleOffset = triangleBase + m.triangle_offset;
+            meshlet.vertexCount = m.vertex_count;
+            meshlet.triangleCount = m.triangle_count;
+            data.meshlets.push_back(meshlet);
+        }
+
+        if (count > 0) {
+            const meshopt_Meshlet& last = meshlets[count - 1];
+            data.vertices.insert(
+                    data.vertices.end(), meshletVertices.begin(),
+                    meshletVertices.begin() + last.vertex_offset +
+                            last.vertex_count);
+            data.triangles.insert(
+                    data.triangles.end(), meshletTriangles.begin(),
+                    meshletTriangles.begin() + last.triangle_offset +
+                            last.triangle_count * 3);
+        }
+    }
+
+    // the shaders read the triangles as 32 bit words
+    data.triangles.resize((data.triangles.size() + 3) & ~size_t{3});
+    return data;
+}
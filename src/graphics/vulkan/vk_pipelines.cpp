@@ -215,8 +215,29 @@ void PipelineBuilder::set_shaders(VkShaderModule vertexShader,
     _shaderStages.emplace_back(vkinit::pipeline_shader_stage_create_info(
             VK_SHADER_STAGE_VERTEX_BIT, vertexShader));
 
+    if (fragmentShader != VK_NULL_HANDLE) {
+        _shaderStages.emplace_back(vkinit::pipeline_shader_stage_create_info(
+                VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+    }
+}
+
+void PipelineBuilder::set_mesh_shaders(VkShaderModule taskShader,
+                                       VkShaderModule meshShader,
+                                       VkShaderModule fragmentShader) {
+    _shaderStages.clear();
+
+    if (taskShader != VK_NULL_HANDLE) {
+        _shaderStages.emplace_back(vkinit::pipeline_shader_stage_create_info(
+                VK_SHADER_STAGE_TASK_BIT_EXT, taskShader));
+    }
+
     _shaderStages.emplace_back(vkinit::pipeline_shader_stage_create_info(
-            VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+            VK_SHADER_STAGE_MESH_BIT_EXT, meshShader));
+
+    if (fragmentShader != VK_NULL_HANDLE) {
+        _shaderStages.emplace_back(vkinit::pipeline_shader_stage_create_info(
+                VK_SHADER_STAGE_FRAGMENT_BIT, fragmentShader));
+    }
 }
 
 void PipelineBuilder::set_input_topology(VkPrimitiveTopology topology) {
@@ -262,6 +283,12 @@ void PipelineBuilder::disable_blending() {
     _colorBlendAttachment.blendEnable = VK_FALSE;
 }
 
+void PipelineBuilder::disable_color_writes() {
+    // the color attachment stays bound but is left untouched
+    _colorBlendAttachment.colorWriteMask = 0;
+    _colorBlendAttachment.blendEnable = VK_FALSE;
+}
+
 void PipelineBuilder::set_color_attachment_format(VkFormat format) {
     _colorAttachmentformat = format;
     // connect the format to the renderInfo  structure
@@ -0,0 +1,112 @@
+#include "graphics/vulkan/vk_ring_buffer.h"
+
+#include <algorithm>
+
+#include "graphics/vulkan/vk_engine.h"
+
+void RingRegion::reset(VkDeviceSize start, VkDeviceSize size) {
+    _start = start;
+    _end = start + size;
+    _head = start;
+    _requested = 0;
+}
+
+std::optional<VkDeviceSize> RingRegion::allocate(VkDeviceSize size,
+                                                 VkDeviceSize alignment) {
+    _requested += size + alignment - 1;
+
+    const VkDeviceSize offset = (_head + alignment - 1) / alignment * alignment;
+    if (offset + size > _end) {
+        return std::nullopt;
+    }
+    _head = offset + size;
+    return offset;
+}
+
+void FrameRingBuffer::init(VulkanEngine* vk_engine, VkDeviceSize bytesPerFrame,
+                           uint32_t frameCount) {
+    _engine = vk_engine;
+    _frameCount = frameCount;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(_engine->_chosenGPU, &properties);
+    _defaultAlignment =
+            std::max(properties.limits.minUniformBufferOffsetAlignment,
+                     properties.limits.minStorageBufferOffsetAlignment);
+
+    create_ring(bytesPerFrame);
+}
+
+FrameRingBuffer::Block FrameRingBuffer::create_block(VkDeviceSize size) const {
+    Block block{};
+    block.buffer = _engine->create_buffer(
+            size,
+            VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+            VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    const VkBufferDeviceAddressInfo deviceAddressInfo{
+            .sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+            .buffer = block.buffer.buffer};
+    block.address =
+            vkGetBufferDeviceAddress(_engine->_device, &deviceAddressInfo);
+    return block;
+}
+
+void FrameRingBuffer::create_ring(VkDeviceSize bytesPerFrame) {
+    // keep every region start aligned for any sub-allocation
+    _bytesPerFrame = (bytesPerFrame + _defaultAlignment - 1) /
+                     _defaultAlignment * _defaultAlignment;
+
+    const Block block = create_block(_bytesPerFrame * _frameCount);
+    _buffer = block.buffer;
+    _address = block.address;
+    _mapped = static_cast<std::byte*>(_buffer.info.pMappedData);
+
+    _region.reset(0, _bytesPerFrame);
+}
+
+void FrameRingBuffer::cleanup() {
+    if (_buffer.buffer != VK_NULL_HANDLE) {
+        _engine->destroy_buffer(_buffer);
+        _buffer = {};
+        _mapped = nullptr;
+    }
+}
+
+bool FrameRingBuffer::begin_frame(uint32_t frameIndex) {
+    bool grown = false;
+    const VkDeviceSize requested = _region.requested();
+    if (requested > _bytesPerFrame) {
+        LOGW("Frame ring buffer grows to {} bytes per frame", requested);
+        // frames in flight still read the old buffer
+        _engine->retire_buffer(_buffer);
+        create_ring(std::max(requested, _bytesPerFrame * 2));
+        grown = true;
+    }
+
+    _region.reset(_bytesPerFrame * frameIndex, _bytesPerFrame);
+    return grown;
+}
+
+RingAllocation FrameRingBuffer::allocate(VkDeviceSize size,
+                                         VkDeviceSize alignment) {
+    if (alignment == 0) {
+        alignment = _defaultAlignment;
+    }
+
+    const std::optional<VkDeviceSize> offset = _region.allocate(size, alignment);
+    if (!offset) {
+        // earlier allocations of the frame are already referenced, so the
+        // ring can not move now. The block lives as long as the frame
+        const Block block = create_block(std::max(size, alignment));
+        _engine->retire_buffer(block.buffer);
+        return RingAllocation{block.buffer.buffer, 0,
+                              block.buffer.info.pMappedData, block.address};
+    }
+
+    return RingAllocation{_buffer.buffer, *offset, _mapped + *offset,
+                          _address + *offset};
+}
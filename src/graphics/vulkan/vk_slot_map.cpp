@@ -0,0 +1,55 @@
+#include "graphics/vulkan/vk_slot_map.h"
+
+SlotHandle SlotMap::insert() {
+    uint32_t slotIndex;
+    if (!_freeSlots.empty()) {
+        slotIndex = _freeSlots.back();
+        _freeSlots.pop_back();
+    } else {
+        slotIndex = static_cast<uint32_t>(_slots.size());
+        _slots.push_back({0, 0});
+    }
+
+    Slot& slot = _slots[slotIndex];
+    slot.generation++;
+    slot.denseIndex = size();
+    _denseToSlot.push_back(slotIndex);
+
+    return {slotIndex, slot.generation};
+}
+
+std::optional<uint32_t> SlotMap::dense_index(SlotHandle handle) const {
+    if (handle.index >= _slots.size() ||
+        _slots[handle.index].generation != handle.generation ||
+        (handle.generation & 1) == 0) {
+        return std::nullopt;
+    }
+    return _slots[handle.index].denseIndex;
+}
+
+std::optional<uint32_t> SlotMap::erase(SlotHandle handle) {
+    const std::optional<uint32_t> denseIndex = dense_index(handle);
+    if (!denseIndex) {
+        return std::nullopt;
+    }
+
+    // the last item moves into the hole
+    const uint32_t lastSlot = _denseToSlot.back();
+    _slots[lastSlot].denseIndex = *denseIndex;
+    _denseToSlot[*denseIndex] = lastSlot;
+    _denseToSlot.pop_back();
+
+    // an even generation marks the slot free and stales every handle to it
+    _slots[handle.index].generation++;
+    _freeSlots.push_back(handle.index);
+
+    return denseIndex;
+}
+
+void SlotMap::clear() {
+    for (const uint32_t slot : _denseToSlot) {
+        _slots[slot].generation++;
+        _freeSlots.push_back(slot);
+    }
+    _denseToSlot.clear();
+}
@@ -0,0 +1,284 @@
+#include "graphics/vulkan/vk_transfer.h"
+
+#include "graphics/vulkan/vk_engine.h"
+#include "graphics/vulkan/vk_images.h"
+#include "graphics/vulkan/vk_initializers.h"
+
+void TransferQueue::init(VulkanEngine* vk_engine, VkQueue queue,
+                         uint32_t queueFamily) {
+    _engine = vk_engine;
+    _queue = queue;
+    _queueFamily = queueFamily;
+    _graphicsQueueFamily = vk_engine->_graphicsQueueFamily;
+
+    const VkCommandPoolCreateInfo commandPoolInfo =
+            vkinit::command_pool_create_info(
+                    _queueFamily, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VkCommandPool commandPool;
+    VK_CHECK(vkCreateCommandPool(_engine->_device, &commandPoolInfo, nullptr,
+                                 &commandPool));
+    _commandPool = std::make_unique<VulkanCommandPool>(_engine->_device,
+                                                       commandPool);
+
+    VkSemaphoreTypeCreateInfo timelineInfo{
+            .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    timelineInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timelineInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo = vkinit::semaphore_create_info();
+    semaphoreInfo.pNext = &timelineInfo;
+
+    VkSemaphore timeline;
+    VK_CHECK(vkCreateSemaphore(_engine->_device, &semaphoreInfo, nullptr,
+                               &timeline));
+    _timeline = std::make_unique<VulkanSemaphore>(_engine->_device, timeline);
+}
+
+void TransferQueue::cleanup() {
+    // the device is idle at this point, so every upload is finished
+    for (const PendingUpload& upload : _pending) {
+        _engine->destroy_buffer(upload.staging);
+    }
+    _pending.clear();
+    _freeCommandBuffers.clear();
+    _bufferAcquires.clear();
+    _imageAcquires.clear();
+
+    _commandPool.reset();
+    _timeline.reset();
+}
+
+UploadTicket TransferQueue::upload_buffers(
+        const AllocatedBuffer& staging, std::span<const BufferUpload> uploads) {
+    const VkCommandBuffer cmd = begin_commands();
+
+    std::vector<VkBufferMemoryBarrier2> releases;
+    for (const BufferUpload& upload : uploads) {
+        VkBufferCopy copy{};
+        copy.srcOffset = upload.srcOffset;
+        copy.dstOffset = upload.dstOffset;
+        copy.size = upload.size;
+        vkCmdCopyBuffer(cmd, staging.buffer, upload.dst, 1, &copy);
+
+        // on a shared family or a concurrently shared buffer the semaphore
+        // wait of the graphics submission already makes the writes visible
+        if (!is_dedicated() || upload.shared) {
+            continue;
+        }
+
+        VkBufferMemoryBarrier2 release{
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+        release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        release.srcQueueFamilyIndex = _queueFamily;
+        release.dstQueueFamilyIndex = _graphicsQueueFamily;
+        release.buffer = upload.dst;
+        release.offset = 0;
+        release.size = VK_WHOLE_SIZE;
+        releases.push_back(release);
+
+        VkBufferMemoryBarrier2 acquire = release;
+        acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        acquire.srcAccessMask = VK_ACCESS_2_NONE;
+        acquire.dstStageMask = upload.dstStage;
+        acquire.dstAccessMask = upload.dstAccess;
+        _bufferAcquires.push_back(acquire);
+    }
+
+    if (!releases.empty()) {
+        VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        depInfo.bufferMemoryBarrierCount =
+                static_cast<uint32_t>(releases.size());
+        depInfo.pBufferMemoryBarriers = releases.data();
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+    }
+
+    return end_commands(cmd, staging);
+}
+
+UploadTicket TransferQueue::upload_images(
+        const AllocatedBuffer& staging, std::span<const ImageUpload> uploads) {
+    const VkCommandBuffer cmd = begin_commands();
+
+    std::vector<VkImageMemoryBarrier2> releases;
+    for (const ImageUpload& upload : uploads) {
+        vkutil::transition_image(cmd, upload.image, VK_IMAGE_LAYOUT_UNDEFINED,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+        VkBufferImageCopy copyRegion = {};
+        copyRegion.bufferOffset = upload.srcOffset;
+        copyRegion.bufferRowLength = 0;
+        copyRegion.bufferImageHeight = 0;
+
+        copyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copyRegion.imageSubresource.mipLevel = 0;
+        copyRegion.imageSubresource.baseArrayLayer = 0;
+        copyRegion.imageSubresource.layerCount = 1;
+        copyRegion.imageExtent = upload.extent;
+
+        vkCmdCopyBufferToImage(cmd, staging.buffer, upload.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+                               &copyRegion);
+
+        const bool mipmapped = upload.mipLevels > 1;
+        const VkExtent2D size{upload.extent.width, upload.extent.height};
+
+        // a family shared with graphics can blit right here
+        if (!is_dedicated()) {
+            if (mipmapped) {
+                vkutil::generate_mipmaps(cmd, upload.image, size,
+                                         upload.mipLevels);
+            } else {
+                vkutil::transition_image(
+                        cmd, upload.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+            }
+            continue;
+        }
+
+        // the layout transition is part of the release/acquire pair, both
+        // halves have to describe it identically
+        VkImageMemoryBarrier2 release{
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+        release.srcStageMask = VK_PIPELINE_STAGE_2_COPY_BIT;
+        release.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        release.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        // mipmapped images stay writable for the blits after the acquire
+        release.newLayout = mipmapped ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+                                      : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        release.srcQueueFamilyIndex = _queueFamily;
+        release.dstQueueFamilyIndex = _graphicsQueueFamily;
+        release.image = upload.image;
+        release.subresourceRange =
+                vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+        releases.push_back(release);
+
+        VkImageMemoryBarrier2 acquire = release;
+        acquire.srcStageMask = VK_PIPELINE_STAGE_2_NONE;
+        acquire.srcAccessMask = VK_ACCESS_2_NONE;
+        if (mipmapped) {
+            acquire.dstStageMask = VK_PIPELINE_STAGE_2_BLIT_BIT;
+            acquire.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT |
+                                    VK_ACCESS_2_TRANSFER_WRITE_BIT;
+            _pendingMips.push_back(upload);
+        } else {
+            acquire.dstStageMask = VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+            acquire.dstAccessMask = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+        }
+        _imageAcquires.push_back(acquire);
+    }
+
+    if (!releases.empty()) {
+        VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        depInfo.imageMemoryBarrierCount =
+                static_cast<uint32_t>(releases.size());
+        depInfo.pImageMemoryBarriers = releases.data();
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+    }
+
+    return end_commands(cmd, staging);
+}
+
+bool TransferQueue::is_complete(UploadTicket ticket) const {
+    return ticket.value <= completed_value();
+}
+
+void TransferQueue::wait(UploadTicket ticket) const {
+    VkSemaphoreWaitInfo waitInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = _timeline->getPtr();
+    waitInfo.pValues = &ticket.value;
+
+    VK_CHECK(vkWaitSemaphores(_engine->_device, &waitInfo, UINT64_MAX));
+}
+
+void TransferQueue::collect() {
+    if (_pending.empty()) {
+        return;
+    }
+
+    const uint64_t completed = completed_value();
+    while (!_pending.empty() && _pending.front().value <= completed) {
+        _engine->destroy_buffer(_pending.front().staging);
+        _freeCommandBuffers.push_back(_pending.front().cmd);
+        _pending.pop_front();
+    }
+}
+
+uint64_t TransferQueue::record_acquires(VkCommandBuffer cmd) {
+    if (!_bufferAcquires.empty() || !_imageAcquires.empty()) {
+        VkDependencyInfo depInfo{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+        depInfo.bufferMemoryBarrierCount =
+                static_cast<uint32_t>(_bufferAcquires.size());
+        depInfo.pBufferMemoryBarriers = _bufferAcquires.data();
+        depInfo.imageMemoryBarrierCount =
+                static_cast<uint32_t>(_imageAcquires.size());
+        depInfo.pImageMemoryBarriers = _imageAcquires.data();
+        vkCmdPipelineBarrier2(cmd, &depInfo);
+
+        _bufferAcquires.clear();
+        _imageAcquires.clear();
+    }
+
+    for (const ImageUpload& upload : _pendingMips) {
+        vkutil::generate_mipmaps(
+                cmd, upload.image,
+                {upload.extent.width, upload.extent.height}, upload.mipLevels);
+    }
+    _pendingMips.clear();
+
+    if (_acquiredValue == _timelineValue) {
+        return 0;
+    }
+    _acquiredValue = _timelineValue;
+    return _acquiredValue;
+}
+
+VkCommandBuffer TransferQueue::begin_commands() {
+    VkCommandBuffer cmd;
+    if (_freeCommandBuffers.empty()) {
+        const VkCommandBufferAllocateInfo cmdAllocInfo =
+                vkinit::command_buffer_allocate_info(_commandPool->get(), 1);
+        VK_CHECK(vkAllocateCommandBuffers(_engine->_device, &cmdAllocInfo,
+                                          &cmd));
+    } else {
+        cmd = _freeCommandBuffers.back();
+        _freeCommandBuffers.pop_back();
+        VK_CHECK(vkResetCommandBuffer(cmd, 0));
+    }
+
+    const VkCommandBufferBeginInfo cmdBeginInfo =
+            vkinit::command_buffer_begin_info(
+                    VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmdBeginInfo));
+
+    return cmd;
+}
+
+UploadTicket TransferQueue::end_commands(VkCommandBuffer cmd,
+                                         const AllocatedBuffer& staging) {
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    const uint64_t value = ++_timelineValue;
+
+    const VkCommandBufferSubmitInfo cmdinfo =
+            vkinit::command_buffer_submit_info(cmd);
+    VkSemaphoreSubmitInfo signalInfo = vkinit::semaphore_submit_info(
+            VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _timeline->get());
+    signalInfo.value = value;
+
+    const VkSubmitInfo2 submit =
+            vkinit::submit_info(&cmdinfo, &signalInfo, nullptr);
+    VK_CHECK(vkQueueSubmit2(_queue, 1, &submit, VK_NULL_HANDLE));
+
+    _pending.push_back({value, cmd, staging});
+
+    return UploadTicket{value};
+}
+
+uint64_t TransferQueue::completed_value() const {
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(_engine->_device, _timeline->get(),
+                                        &value));
+    return value;
+}
@@ -0,0 +1,60 @@
+#include "graphics/vulkan/vk_vertex_packing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/common.hpp>
+#include <glm/gtc/packing.hpp>
+
+namespace {
+// octahedral mapping of a unit vector onto [-1, 1]^2
+glm::vec2 encode_octahedral(glm::vec3 n) {
+    const float length = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (length == 0.f) {
+        return {0.f, 0.f};
+    }
+    n /= length;
+
+    glm::vec2 e{n.x, n.y};
+    if (n.z < 0.f) {
+        // fold the lower hemisphere over the diagonals
+        const glm::vec2 sign{n.x >= 0.f ? 1.f : -1.f, n.y >= 0.f ? 1.f : -1.f};
+        e = (1.f - glm::abs(glm::vec2{n.y, n.x})) * sign;
+    }
+    return e;
+}
+}  // namespace
+
+glm::vec4 vkutil::pack_vertices(std::span<const Vertex> vertices,
+                                std::vector<PackedVertex>& packed) {
+    packed.resize(vertices.size());
+    if (vertices.empty()) {
+        return {0.f, 0.f, 0.f, 1.f};
+    }
+
+    glm::vec3 min = vertices[0].position;
+    glm::vec3 max = vertices[0].position;
+    for (const Vertex& v : vertices) {
+        min = glm::min(min, v.position);
+        max = glm::max(max, v.position);
+    }
+
+    // one scale for all axes keeps the decode a uniform scale, so normals
+    // transformed by the instance matrix are unaffected
+    const glm::vec3 origin = (min + max) * 0.5f;
+    const glm::vec3 halfExtent = (max - min) * 0.5f;
+    const float scale =
+            std::max({halfExtent.x, halfExtent.y, halfExtent.z, 1e-6f});
+
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& v = vertices[i];
+        const glm::vec3 p = (v.position - origin) / scale;
+
+        packed[i].positionXY = glm::packSnorm2x16(glm::vec2{p.x, p.y});
+        packed[i].positionZ = glm::packSnorm2x16(glm::vec2{p.z, 0.f});
+        packed[i].normal = glm::packSnorm2x16(encode_octahedral(v.normal));
+        packed[i].uv = glm::packHalf2x16(glm::vec2{v.uv_x, v.uv_y});
+        packed[i].color = glm::packUnorm4x8(v.color);
+    }
+
+    return {origin, scale};
+}
@@ -14,6 +14,7 @@ public:
     void init() const override;
     void update() const override;
     void processEvent(SDL_Event& e) const override;
+    void runHeadless(uint32_t frameCount) const override;
 
 private:
     std::shared_ptr<IModel> _model;
@@ -21,5 +21,5 @@ public:
 private:
     glm::mat4 _transform;
     std::string _currentModelPath;  // Track current model path
-    int64_t _rid;
+    SlotHandle _rid;
 };
\ No newline at end of file
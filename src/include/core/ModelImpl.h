@@ -23,6 +23,7 @@ public:
     ModelImpl &operator=(const ModelImpl &) = delete;
 
     void registerWindow(struct SDL_Window *window) override;
+    void registerHeadless(uint32_t width, uint32_t height) override;
     void updateVulkan() override;
 
     void createMesh(std::string name) override;
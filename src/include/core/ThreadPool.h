@@ -0,0 +1,41 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads fed from a single job queue. Used for work that
+// splits into independent chunks, like recording secondary command buffers.
+class ThreadPool {
+public:
+    // threadCount == 0 picks one worker per hardware thread minus the caller
+    explicit ThreadPool(uint32_t threadCount = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t size() const { return static_cast<uint32_t>(_workers.size()); }
+
+    std::future<void> submit(std::function<void()> job);
+
+    // runs task(i) for every i in [0; count) on the workers and the calling
+    // thread, returns once all of them are done. If a task throws, the
+    // remaining indices are skipped and the first exception is rethrown
+    // after every worker has stopped
+    void parallelFor(uint32_t count, const std::function<void(uint32_t)>& task);
+
+private:
+    void workerLoop();
+
+    std::vector<std::thread> _workers;
+    std::queue<std::packaged_task<void()>> _jobs;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    bool _stopping{false};
+};
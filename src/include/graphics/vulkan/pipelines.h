@@ -12,17 +12,26 @@
 #include "ComputePipeline.h"
 
 class VulkanEngine;
+class BindlessTable;
 
 struct GLTFMetallic_Roughness {
     MaterialPipeline opaquePipeline;
     MaterialPipeline transparentPipeline;
-
-    VkDescriptorSetLayout materialLayout;
+    // same passes, fed per-draw data from a buffer by indirect draws
+    MaterialPipeline opaqueIndirectPipeline;
+    MaterialPipeline transparentIndirectPipeline;
+    // depth only opaque passes for the depth prepass
+    MaterialPipeline opaqueDepthPipeline;
+    MaterialPipeline opaqueDepthIndirectPipeline;
+    // task and mesh shader variants of the direct passes, drawing meshlets.
+    // Only built when the device supports mesh shaders
+    MaterialPipeline opaqueMeshletPipeline;
+    MaterialPipeline transparentMeshletPipeline;
+    MaterialPipeline opaqueDepthMeshletPipeline;
 
     struct MaterialConstants {
         glm::vec4 colorFactors;
         glm::vec4 metal_rough_factors;
-        glm::vec4 extra[14];
     };
 
     struct MaterialResources {
@@ -30,31 +39,58 @@ struct GLTFMetallic_Roughness {
         VkSampler colorSampler;
         AllocatedImage metalRoughImage;
         VkSampler metalRoughSampler;
-        VkBuffer dataBuffer;
-        uint32_t dataBufferOffset;
+        MaterialConstants constants;
     };
 
-    DescriptorWriter writer;
-
     void build_pipelines(VulkanEngine* engine);
     void clear_resources(VkDevice device);
-    MaterialInstance write_material(
-            VkDevice device, MaterialPass pass,
-            const MaterialResources& resources,
-            DescriptorAllocatorGrowable& descriptorAllocator);
+    // indirect variant of one of the direct pipelines above
+    const MaterialPipeline& indirect_pipeline(
+            const MaterialPipeline* pipeline) const;
+    // meshlet variant of one of the direct pipelines above
+    const MaterialPipeline& meshlet_pipeline(
+            const MaterialPipeline* pipeline) const;
+    // registers the images, samplers and constants in the bindless table
+    MaterialInstance write_material(MaterialPass pass,
+                                    const MaterialResources& resources,
+                                    BindlessTable& table);
+    // drops the table references taken by write_material
+    static void release_material(const MaterialInstance& material,
+                                 BindlessTable& table);
 
 private:
+    // of the opaque and depth pipelines, glTF double sided materials are
+    // drawn like the rest
+    static constexpr VkCullModeFlags CULL_MODE = VK_CULL_MODE_NONE;
+
+    // stages ahead of the fragment shader, either a vertex shader or a task
+    // and mesh shader pair
+    struct GeometryShaders {
+        VkShaderModule vertex{VK_NULL_HANDLE};
+        VkShaderModule task{VK_NULL_HANDLE};
+        VkShaderModule mesh{VK_NULL_HANDLE};
+    };
+
+    void build_meshlet_pipelines(VulkanEngine* engine,
+                                 VkShaderModule fragShader);
     VkShaderModule load_shader(VulkanEngine* engine, const char* path,
                                const char* type);
-    void create_material_layout(VulkanEngine* engine);
-    VkPipelineLayout create_pipeline_layout(VulkanEngine* engine);
-    void build_opaque_pipeline(VulkanEngine* engine,
-                               VkShaderModule vertexShader,
-                               VkShaderModule fragShader,
-                               VkPipelineLayout layout);
-    void build_transparent_pipeline(VulkanEngine* engine,
-                                    VkShaderModule vertexShader,
-                                    VkShaderModule fragShader,
+    VkPipelineLayout create_pipeline_layout(VulkanEngine* engine,
+                                            VkShaderStageFlags pushStages,
+                                            uint32_t pushSize);
+    static void set_shaders(PipelineBuilder& builder,
+                            const GeometryShaders& geometry,
+                            VkShaderModule fragShader);
+    VkPipeline build_opaque_pipeline(VulkanEngine* engine,
+                                     const GeometryShaders& geometry,
+                                     VkShaderModule fragShader,
+                                     VkPipelineLayout layout);
+    VkPipeline build_transparent_pipeline(VulkanEngine* engine,
+                                          const GeometryShaders& geometry,
+                                          VkShaderModule fragShader,
+                                          VkPipelineLayout layout);
+    VkPipeline build_depth_pipeline(VulkanEngine* engine,
+                                    const GeometryShaders& geometry,
                                     VkPipelineLayout layout);
 };
 
@@ -63,10 +99,12 @@ public:
     std::unique_ptr<GraphicsPipeline> trianglePipeline;
     std::unique_ptr<GraphicsPipeline> meshPipeline;
     std::unique_ptr<ComputePipeline> gradientPipeline;
+    std::unique_ptr<ComputePipeline> cullPipeline;
 
     void init(VkDevice device,
               VkDescriptorSetLayout singleImageDescriptorLayout,
               VkDescriptorSetLayout drawImageDescriptorLayout,
+              VkDescriptorSetLayout depthPyramidDescriptorLayout,
               AllocatedImage drawImage);
     void destroy();
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class VulkanEngine;
+struct LoadedGLTF;
+
+// Scenes loaded by registerMesh, shared by every registration of the same
+// contents. Entries are keyed by a hash of the file bytes, so one file
+// reached through two paths, or copied under another name, is loaded and
+// uploaded once. Each path remembers its hash together with the file size
+// and write time, a repeat registration only reads the file again when it
+// changed on disk.
+//
+// Entries are reference counted by acquire/release. The last release retires
+// the scene; it is destroyed by collect() once no frame in flight can draw it.
+class AssetCache {
+public:
+    void init(VulkanEngine* vk_engine);
+    // destroys every scene, the device must be idle
+    void cleanup();
+
+    // the scene in filePath, loaded on first use. nullptr when it fails to
+    // load
+    std::shared_ptr<LoadedGLTF> acquire(const std::filesystem::path& filePath);
+    void release(const std::shared_ptr<LoadedGLTF>& scene);
+
+    // destroys retired scenes the GPU is done with. Called once per frame
+    // after waiting for the frame slot
+    void collect();
+
+    size_t size() const { return _entries.size(); }
+
+    // every scene that still holds GPU resources, retired ones included
+    template <typename F>
+    void for_each_scene(F&& f) const {
+        for (const auto& [hash, entry] : _entries) {
+            f(*entry.scene);
+        }
+        for (const Retired& retired : _retired) {
+            f(*retired.scene);
+        }
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<LoadedGLTF> scene;
+        uint32_t refCount{0};
+    };
+
+    struct PathInfo {
+        uint64_t hash;
+        uintmax_t fileSize;
+        std::filesystem::file_time_type writeTime;
+    };
+
+    struct Retired {
+        std::shared_ptr<LoadedGLTF> scene;
+        uint64_t frame;
+    };
+
+    VulkanEngine* _engine{nullptr};
+
+    std::unordered_map<uint64_t, Entry> _entries;
+    std::unordered_map<std::string, PathInfo> _paths;
+    // reverse lookup for release
+    std::unordered_map<const LoadedGLTF*, uint64_t> _hashes;
+    std::vector<Retired> _retired;
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+constexpr uint32_t MAX_BINDLESS_IMAGES = 4096;
+constexpr uint32_t MAX_BINDLESS_SAMPLERS = 256;
+constexpr uint32_t MAX_BINDLESS_MATERIALS = 4096;
+
+// material record in the bindless material buffer, mirrors `Material` in
+// shaders/input_structures.glsl
+struct GPUMaterial {
+    glm::vec4 colorFactors;
+    glm::vec4 metalRoughFactors;
+    uint32_t colorImage;
+    uint32_t colorSampler;
+    uint32_t metalRoughImage;
+    uint32_t metalRoughSampler;
+};
+
+// One descriptor set, bound once per frame, holding every sampled image,
+// every sampler and an SSBO of all materials. Draws select their material
+// with an index instead of binding a set. The arrays are update-after-bind
+// and partially bound, so slots can be filled while frames are in flight.
+//
+// Images and samplers are deduplicated by handle and reference counted.
+// Slots freed here may be reused by the next add, callers must make sure no
+// in-flight frame still reads them.
+class BindlessTable {
+public:
+    void init(VulkanEngine* vk_engine);
+    void cleanup();
+
+    uint32_t add_image(VkImageView view);
+    void remove_image(uint32_t index);
+
+    uint32_t add_sampler(VkSampler sampler);
+    void remove_sampler(uint32_t index);
+
+    uint32_t add_material(const GPUMaterial& material);
+    void remove_material(uint32_t index);
+    const GPUMaterial& material(uint32_t index) const {
+        return _materials[index];
+    }
+
+    VkDescriptorSetLayout layout() const { return _layout; }
+    VkDescriptorSet set() const { return _set; }
+
+private:
+    // fixed capacity slot array with reuse of freed slots
+    struct Slots {
+        std::vector<uint32_t> refCounts;
+        std::vector<uint32_t> freeList;
+        uint32_t next{0};
+
+        uint32_t acquire(uint32_t capacity);
+        // true when the slot is now unused
+        bool release(uint32_t index);
+    };
+
+    VulkanEngine* _engine{nullptr};
+
+    VkDescriptorSetLayout _layout{VK_NULL_HANDLE};
+    VkDescriptorPool _pool{VK_NULL_HANDLE};
+    VkDescriptorSet _set{VK_NULL_HANDLE};
+
+    AllocatedBuffer _materialBuffer{};
+    GPUMaterial* _materials{nullptr};
+
+    Slots _imageSlots;
+    Slots _samplerSlots;
+    Slots _materialSlots;
+
+    std::unordered_map<VkImageView, uint32_t> _imageIndices;
+    std::unordered_map<VkSampler, uint32_t> _samplerIndices;
+    std::vector<VkImageView> _images;
+    std::vector<VkSampler> _samplers;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <glm/ext/matrix_float4x4.hpp>
+#include <glm/ext/vector_float4.hpp>
+#include <vector>
+
+// world space planes, xyz is the inward facing unit normal and w the
+// distance, so a point p is inside when dot(plane.xyz, p) + plane.w >= 0
+struct Frustum {
+    std::array<glm::vec4, 6> planes;
+};
+
+// world space bounding spheres stored as structure of arrays, so the
+// culling loop can load four of them per register. The arrays are padded
+// to a multiple of four
+struct CullSpheres {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> radius;
+    uint32_t count{0};
+
+    void clear();
+    void push(const glm::vec4& sphere);
+};
+
+// drops spheres whose projected radius is below a fraction of the screen
+// height. depthPlane gives view space depth as dot(xyz, p) + w
+struct ScreenSizeCull {
+    glm::vec4 depthPlane;
+    // minimum radius / depth ratio, 0 disables the test
+    float minRadiusOverDepth{0.f};
+};
+
+namespace vkutil {
+// planes of a Vulkan style projection (clip z in [0, w]) times view matrix.
+// Works for reversed depth as well since only the half spaces are used
+Frustum extract_frustum(const glm::mat4& viewproj);
+
+// writes 1 to visible[i] when sphere i intersects the frustum and passes the
+// screen size test, 0 otherwise. Uses SSE when available, four spheres at a
+// time
+void cull_spheres(const Frustum& frustum, const ScreenSizeCull& screenSize,
+                  const CullSpheres& spheres, std::vector<uint8_t>& visible);
+// one sphere at a time, what cull_spheres does without SSE
+void cull_spheres_scalar(const Frustum& frustum,
+                         const ScreenSizeCull& screenSize,
+                         const CullSpheres& spheres,
+                         std::vector<uint8_t>& visible);
+}  // namespace vkutil
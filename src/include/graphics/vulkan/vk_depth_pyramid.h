@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "ComputePipeline.h"
+#include "vk_descriptors.h"
+#include "vk_types.h"
+
+class VulkanEngine;
+
+// Hierarchical Z buffer reduced from the engine's depth image. Every texel
+// holds the farthest depth (the smallest one, depth is reversed) of the
+// texels it covers in the level below, so one sample tells whether a screen
+// rectangle is entirely behind what was drawn. Level 0 is the depth image
+// size rounded down to a power of two. The pyramid stays in GENERAL layout
+class DepthPyramid {
+public:
+    void init(VulkanEngine* vk_engine);
+    void cleanup();
+
+    // reduces the depth image into every level. The depth image must be in
+    // DEPTH_ATTACHMENT_OPTIMAL and is left in it
+    void build(VkCommandBuffer cmd);
+
+    VkExtent2D extent() const { return _extent; }
+
+    // the whole pyramid as a combined image sampler with a min reduction
+    // sampler, for the culling pass
+    VkDescriptorSetLayout sample_layout() const { return _sampleLayout; }
+    VkDescriptorSet sample_set() const { return _sampleSet; }
+
+private:
+    VulkanEngine* _engine{nullptr};
+
+    AllocatedImage _image{};
+    VkExtent2D _extent{};
+    uint32_t _levelCount{0};
+    std::vector<VkImageView> _levelViews;
+
+    VkSampler _reductionSampler{VK_NULL_HANDLE};
+
+    DescriptorAllocator _descriptorAllocator{};
+    VkDescriptorSetLayout _reduceLayout{VK_NULL_HANDLE};
+    VkDescriptorSetLayout _sampleLayout{VK_NULL_HANDLE};
+    // level i reads level i - 1, level 0 reads the depth image
+    std::vector<VkDescriptorSet> _reduceSets;
+    VkDescriptorSet _sampleSet{VK_NULL_HANDLE};
+
+    std::unique_ptr<ComputePipeline> _reducePipeline;
+};
@@ -1,7 +1,9 @@
 ﻿#pragma once
 
+#include <array>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <glm/ext/matrix_float4x4.hpp>
 #include <glm/ext/vector_float4.hpp>
 #include <memory>
@@ -20,25 +22,50 @@
 #include "pipelines.h"
 #include "ComputePipeline.h"
 
+#include "vk_asset_cache.h"
+#include "vk_bindless.h"
 #include "vk_command_buffers.h"
+#include "vk_culling.h"
+#include "vk_depth_pyramid.h"
+#include "vk_geometry_buffer.h"
+#include "vk_ring_buffer.h"
+#include "vk_slot_map.h"
+#include "vk_transfer.h"
+
+#include "core/ThreadPool.h"
 
 class Camera;
 class VulkanEngine;
 struct DrawContext;
 struct LoadedGLTF;
 struct MeshAsset;
+struct MeshletData;
 
-constexpr unsigned int FRAME_OVERLAP = 2;
+// upper bound for EngineConfig::framesInFlight, per-frame resources are
+// created for this many frames
+constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 4;
 
 struct FrameData {
     std::unique_ptr<VulkanCommandPool> _commandPool;
     VkCommandBuffer _mainCommandBuffer;
+    // records the swapchain copy and UI when EngineConfig::lowLatency splits
+    // the frame into a scene and a present submission
+    VkCommandBuffer _presentCommandBuffer;
+
+    // one pool and secondary command buffer per recording chunk, so workers
+    // never share a pool. Reset as a whole at the start of the frame
+    std::vector<std::unique_ptr<VulkanCommandPool>> _workerCommandPools;
+    std::vector<VkCommandBuffer> _workerCommandBuffers;
 
-    std::unique_ptr<VulkanSemaphore> _swapchainSemaphore, _renderSemaphore;
-    std::unique_ptr<VulkanFence> _renderFence;
+    // async compute work of the frame, see VulkanEngine::schedule_compute
+    std::unique_ptr<VulkanCommandPool> _computeCommandPool;
+    VkCommandBuffer _computeCommandBuffer;
 
-    DescriptorAllocatorGrowable _frameDescriptors;
-    std::vector<std::unique_ptr<VulkanBuffer>> _frameBuffers; // For per-frame temporary buffers
+    std::unique_ptr<VulkanSemaphore> _swapchainSemaphore;
+
+    // value of the frame timeline semaphore signaled when the last submission
+    // of this frame finishes on the GPU
+    uint64_t _timelineValue{0};
 };
 
 struct GPUSceneData {
@@ -58,19 +85,169 @@ struct MeshNode : public ENode {
     void Draw(const glm::mat4& topMatrix, DrawContext& ctx) override;
 };
 
+// every surface indexes the shared index buffer of GeometryBuffer, so the
+// first index alone identifies its index range
 struct RenderObject {
     uint32_t indexCount;
     uint32_t firstIndex;
-    VkBuffer indexBuffer;
 
     MaterialInstance* material;
 
     glm::mat4 transform;
     VkDeviceAddress vertexBufferAddress;
+    glm::vec4 positionDequant;
+
+    Bounds bounds;
+    // simplified levels of the surface, see GeoSurface::lods
+    std::span<const SurfaceLod> lods;
+    // meshlets of the full surface in meshBuffers, a count of 0 draws with
+    // vertex pulling
+    const GPUMeshBuffers* meshBuffers;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
 };
 
 struct DrawContext {
     std::vector<RenderObject> OpaqueSurfaces;
+    // base of the shared vertex buffer, mesh vertex offsets are relative to
+    // it. Set by the engine before gathering, the buffer moves when it grows
+    VkDeviceAddress vertexBufferAddress{0};
+};
+
+// pixels of one image for create_images, tightly packed in the texel size of
+// format
+struct ImageData {
+    const void* data;
+    VkExtent3D size;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    bool mipmapped{false};
+};
+
+// copies of one surface, recorded as one instanced vkCmdDrawIndexed. The
+// first copy stands in for all of them except for the transforms
+struct InstancedDraw {
+    const RenderObject* draw;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// one frame's instanced draws, the transforms live in the frame ring
+struct InstancedDrawList {
+    std::vector<InstancedDraw> draws;
+    // packed glm::mat3x4 transform per instance, grouped by draw
+    RingAllocation instances;
+};
+
+// draws sharing a pipeline, recorded as one vkCmdDrawIndexedIndirectCount
+struct IndirectBatch {
+    const MaterialPipeline* pipeline;
+    uint32_t first;
+    uint32_t count;
+};
+
+// one frame's indirect draws, all allocations live in the frame ring
+struct IndirectDrawList {
+    std::vector<IndirectBatch> batches;
+    // VkDrawIndexedIndirectCommand per draw, grouped by batch, as written
+    // by the CPU
+    RingAllocation sourceCommands;
+    // commands to draw, the source commands or the output of a cull pass
+    RingAllocation commands;
+    // GPUDrawData per draw
+    RingAllocation drawData;
+    // GPUIndirectBatch per batch, doubles as the count buffer
+    RingAllocation batchCounts;
+};
+
+struct EngineConfig {
+    // render into _drawImage only: no SDL window, surface or swapchain.
+    // works on software ICDs such as lavapipe
+    bool headless{false};
+    // size of the draw image when running headless
+    VkExtent2D headlessExtent{1920, 1080};
+    // how many frames the CPU may record ahead of the GPU, [1;
+    // MAX_FRAMES_IN_FLIGHT]. More frames hide GPU stalls, fewer frames lower
+    // latency
+    uint32_t framesInFlight{2};
+    // requested swapchain present mode. MAILBOX and IMMEDIATE fall back to
+    // each other, everything falls back to FIFO which is always supported
+    VkPresentModeKHR presentMode{VK_PRESENT_MODE_FIFO_KHR};
+    // sample the camera after the frame slot is free and acquire the
+    // swapchain image only once the scene is submitted. Shortens
+    // input-to-photon latency at the cost of less CPU/GPU overlap
+    bool lowLatency{false};
+    // worker threads used to record draws, 0 picks one per hardware thread
+    uint32_t recordThreads{0};
+    // run the background pass on the async compute queue instead of inline
+    // in the graphics command buffer
+    bool asyncCompute{false};
+    // initial size of each frame's region in the transient ring buffer,
+    // it grows when a frame needs more
+    VkDeviceSize frameRingBytes{4 * 1024 * 1024};
+    // initial size of the shared vertex buffer in bytes and of the shared
+    // index buffer in indices. Both grow when a mesh does not fit
+    VkDeviceSize geometryVertexBytes{64ull * 1024 * 1024};
+    uint32_t geometryIndexCount{16 * 1024 * 1024};
+    // compact the geometry buffers before a frame once this share of their
+    // used extent is holes left by unloaded meshes. 1 never compacts
+    float geometryCompactThreshold{0.25f};
+    // draw opaque surfaces with one vkCmdDrawIndexedIndirectCount per
+    // pipeline and index buffer instead of one vkCmdDrawIndexed each
+    bool indirectDraw{false};
+    // frustum cull the indirect draws in a compute pass before drawing
+    bool gpuCulling{true};
+    // two phase occlusion culling against a depth pyramid on top of the GPU
+    // frustum culling: last frame's visible draws are drawn first, the
+    // pyramid is built from their depth and the remaining draws are tested
+    // against it
+    bool occlusionCulling{false};
+    // frustum cull surfaces on the CPU in update_scene. Skipped while the
+    // GPU culls the indirect draws
+    bool cpuCulling{true};
+    // CPU culling also drops surfaces whose bounding sphere is smaller than
+    // this fraction of the screen height, 0 disables
+    float cullMinScreenSize{0.f};
+    // lay down the depth of the opaque surfaces in a depth only pass, so the
+    // color pass shades each pixel once
+    bool depthPrepass{false};
+    // upload meshes as PackedVertex (20 bytes) instead of Vertex (48
+    // bytes). Applies to meshes loaded afterwards
+    bool compactVertices{false};
+    // reorder the indices and vertices of loaded meshes for the vertex
+    // cache, overdraw and fetch locality. Prints the ACMR before and after
+    bool optimizeMeshes{true};
+    // build a chain of simplified index ranges per surface when loading
+    bool generateLods{false};
+    // draw the coarsest LOD whose error projects to at most this many
+    // pixels, 0 always draws the full surfaces
+    float lodErrorPixels{1.f};
+    // draw surfaces as meshlets through task and mesh shaders, which cull
+    // them per cluster. Ignored without VK_EXT_mesh_shader; surfaces drawn
+    // at a simplified LOD or through the indirect path keep vertex pulling
+    bool meshShading{false};
+};
+
+// work for the async compute queue, recorded once into the frame's compute
+// command buffer and submitted ahead of the graphics work of the same frame
+struct ComputePass {
+    std::function<void(VkCommandBuffer cmd)> record;
+    // first graphics stage that consumes the results of the pass
+    VkPipelineStageFlags2 graphicsWaitStage{VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT};
+    // set when the pass writes resources the previous frame may still be
+    // reading, such as the draw image. Serializes it after that frame
+    bool waitPreviousFrame{false};
+};
+
+struct EngineStats {
+    float frametime;       // CPU time of the last draw() in ms
+    float fenceWaitTime;   // CPU time blocked waiting for a free frame in ms
+    uint64_t frameCount;
+    uint32_t surfaceCount;  // opaque surfaces gathered by update_scene
+    uint32_t visibleCount;  // of those, surfaces left after CPU culling
+    uint32_t drawCount;     // draw calls recorded for them after instancing
+    uint32_t triangleCount; // triangles of the visible surfaces after LOD
+                            // selection
 };
 
 class VulkanEngine {
@@ -80,15 +257,17 @@ public:
 
     CommandBuffers command_buffers;
 
-    int64_t registerMesh(const std::string& filePath);
-
-    void unregisterMesh(int64_t id);
+    SlotHandle registerMesh(const std::string& filePath);
 
-    void setMeshTransform(int64_t id, glm::mat4 mat);
+    // stale handles are ignored
+    void unregisterMesh(SlotHandle handle);
 
-    std::unordered_map<int64_t, std::shared_ptr<LoadedGLTF>> meshes;
+    void setMeshTransform(SlotHandle handle, glm::mat4 mat);
 
-    std::unordered_map<int64_t, glm::mat4> transforms;
+    // registered meshes, packed in the dense order of mesh_slots
+    SlotMap mesh_slots;
+    std::vector<std::shared_ptr<LoadedGLTF>> meshes;
+    std::vector<glm::mat4> transforms;
 
     std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> loadedScenes;
 
@@ -99,15 +278,78 @@ public:
 
     void update_scene();
 
-    FrameData _frames[FRAME_OVERLAP];
+    std::array<FrameData, MAX_FRAMES_IN_FLIGHT> _frames;
+    uint32_t _framesInFlight{2};
+
+    // one timeline semaphore paces all frames: frame N signals value N + 1
+    std::unique_ptr<VulkanSemaphore> _frameTimeline;
+    uint64_t _frameTimelineValue{0};
 
     FrameData& get_current_frame() {
-        return _frames[_frameNumber % FRAME_OVERLAP];
+        return _frames[_frameNumber % _framesInFlight];
     };
 
+    // waits for the GPU to go idle, so it is not meant to be called per frame
+    void set_frames_in_flight(uint32_t count);
+
+    std::unique_ptr<ThreadPool> _workerPool;
+
+    // recreates the swapchain on the next update()
+    void set_present_mode(VkPresentModeKHR mode);
+
+    // present mode the swapchain was actually created with
+    VkPresentModeKHR _presentMode{VK_PRESENT_MODE_FIFO_KHR};
+
     VkQueue _graphicsQueue;
     uint32_t _graphicsQueueFamily;
 
+    TransferQueue transfer_queue;
+
+    // transient per-frame data, rewound every frame
+    FrameRingBuffer frame_ring;
+
+    // vertices and indices of every mesh
+    GeometryBuffer geometry_buffer;
+
+    // packs the geometry buffers and moves the meshes along. The next frame
+    // records the copies, must not be called while one is recorded
+    void compact_geometry();
+
+    // every material texture, sampler and constant block, bound as set 1
+    BindlessTable bindless_table;
+
+    // scenes of registerMesh, shared by every copy of a mesh so that their
+    // surfaces can be instanced
+    AssetCache asset_cache;
+
+    DepthPyramid depth_pyramid;
+    // last frame's visibility of each indirect draw, in sorted draw order
+    AllocatedBuffer _drawVisibility{};
+    VkDeviceAddress _drawVisibilityAddress{0};
+    uint32_t _drawVisibilityCapacity{0};
+
+    // a compute-only family when the device has one, else another family
+    // with compute, else the graphics queue itself
+    VkQueue _computeQueue;
+    uint32_t _computeQueueFamily;
+
+    // signaled by async compute submissions, graphics waits on it
+    std::unique_ptr<VulkanSemaphore> _computeTimeline;
+    uint64_t _computeTimelineValue{0};
+
+    // queues a pass for the async compute submission of the next draw()
+    void schedule_compute(ComputePass pass);
+
+    // VK_EXT_mesh_shader with task and mesh shaders is enabled, meshes are
+    // split into meshlets when loaded
+    bool _meshShaderSupported{false};
+    PFN_vkCmdDrawMeshTasksEXT _vkCmdDrawMeshTasksEXT{nullptr};
+    // task workgroup limits of one vkCmdDrawMeshTasksEXT, larger draws are
+    // split
+    uint32_t _maxTaskGroupCountX{0};
+    uint32_t _maxTaskGroupCountY{0};
+    uint32_t _maxTaskGroupTotal{0};
+
     bool _isInitialized{false};
     unsigned int _frameNumber{0};
     bool stop_rendering{false};
@@ -117,8 +359,12 @@ public:
 
     static VulkanEngine& Get();
 
-    // initializes everything in the engine
-    void init(struct SDL_Window* window);
+    EngineConfig _config;
+    EngineStats stats{};
+
+    // initializes everything in the engine. window may be nullptr when
+    // config.headless is set
+    void init(struct SDL_Window* window, const EngineConfig& config = {});
 
     // shuts down the engine
     void cleanup();
@@ -140,18 +386,30 @@ public:
 
     std::vector<VkImage> _swapchainImages;
     std::vector<VkImageView> _swapchainImageViews;
+    // signaled when rendering into the swapchain image with the same index is
+    // done. Present has no completion signal, so they can not live per frame
+    std::vector<std::unique_ptr<VulkanSemaphore>> _renderSemaphores;
     VkExtent2D _swapchainExtent;
 
     VmaAllocator _allocator;
 
     std::unique_ptr<VulkanImage> _drawImage;
     std::unique_ptr<VulkanImage> _depthImage;
-    VkExtent2D _drawExtent;
+    // part of the draw image rendered to, set at the start of draw()
+    VkExtent2D _drawExtent{};
     float renderScale = 1.f;
 
     DescriptorAllocatorGrowable globalDescriptorAllocator;
 
     VkDescriptorSet _drawImageDescriptors;
+    // written once, the scene data slice is selected by a dynamic offset
+    VkDescriptorSet _sceneDataDescriptors{VK_NULL_HANDLE};
+    // sets replaced by a grown ring, reused once no frame in flight binds them
+    struct RetiredSet {
+        VkDescriptorSet set;
+        uint64_t frame;
+    };
+    std::vector<RetiredSet> _retiredSceneDataDescriptors;
     VkDescriptorSetLayout _drawImageDescriptorLayout;
 
     // immediate submit structures
@@ -161,12 +419,16 @@ public:
 
     GPUMeshBuffers rectangle;
 
+    // uploads run asynchronously on the transfer queue; the buffers may be
+    // drawn right away, frames wait for the copy on the GPU. ticket, when
+    // given, receives the completion token
     GPUMeshBuffers uploadMesh(std::span<uint32_t> indices,
-                              std::span<Vertex> vertices);
+                              std::span<Vertex> vertices,
+                              UploadTicket* ticket = nullptr);
 
     std::vector<std::shared_ptr<MeshAsset>> testMeshes;
 
-    bool resize_requested;
+    bool resize_requested{false};
 
     GPUSceneData sceneData;
 
@@ -175,9 +437,18 @@ public:
     AllocatedImage create_image(VkExtent3D size, VkFormat format,
                                 VkImageUsageFlags usage,
                                 bool mipmapped = false) const;
+    // asynchronous like uploadMesh
     AllocatedImage create_image(const void* data, VkExtent3D size,
                                 VkFormat format, VkImageUsageFlags usage,
-                                bool mipmapped = false) const;
+                                bool mipmapped = false,
+                                UploadTicket* ticket = nullptr);
+    // all images through one staging buffer and one transfer submission,
+    // mips are generated on the GPU. Empty when any format has no known
+    // texel size, nothing is created then
+    std::vector<AllocatedImage> create_images(std::span<const ImageData> images,
+                                              UploadTicket* ticket = nullptr);
+    // whether the mip chain of an image in format can be blitted
+    bool supports_mip_generation(VkFormat format) const;
     void destroy_image(const AllocatedImage& img) const;
 
     std::unique_ptr<VulkanImage> _whiteImage;
@@ -195,12 +466,45 @@ public:
 
     AllocatedBuffer create_buffer(size_t allocSize, VkBufferUsageFlags usage,
                                   VmaMemoryUsage memoryUsage) const;
+    void destroy_buffer(const AllocatedBuffer& buffer) const;
+    // buffer used concurrently by the graphics and the transfer queue family,
+    // uploads write parts of it while the graphics queue reads the rest
+    AllocatedBuffer create_shared_buffer(size_t allocSize,
+                                         VkBufferUsageFlags usage,
+                                         VmaMemoryUsage memoryUsage) const;
+    // destroys the buffer once no frame recorded so far can read it
+    void retire_buffer(const AllocatedBuffer& buffer);
+    // uploads the meshlets of a mesh into meshBuffers, asynchronous like
+    // uploadMesh
+    void upload_meshlets(const MeshletData& meshlets,
+                         GPUMeshBuffers& meshBuffers);
+    // frees what uploadMesh and upload_meshlets allocated
+    void destroy_mesh_buffers(const GPUMeshBuffers& meshBuffers);
 
 private:
+    struct RetiredBuffer {
+        AllocatedBuffer buffer;
+        uint64_t frame;
+    };
+    std::vector<RetiredBuffer> _retiredBuffers;
+    // destroys retired buffers the GPU is done with, after waiting for the
+    // frame slot
+    void collect_retired_buffers();
+
     // Smart pointer collections for automatic cleanup
     std::vector<std::unique_ptr<VulkanBuffer>> _managedBuffers;
     std::vector<std::unique_ptr<VulkanImage>> _managedImages;
 
+    // scratch of cull_surfaces, kept to avoid reallocating every frame
+    CullSpheres _cullSpheres;
+    std::vector<uint8_t> _cullVisible;
+
+
+    // removes surfaces outside the camera frustum from mainDrawContext
+    void cull_surfaces();
+    // switches surfaces to the LOD matching their projected size
+    void select_lods();
+
     static VKAPI_ATTR VkBool32 VKAPI_CALL
     debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
                   VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -211,12 +515,68 @@ private:
     void init_swapchain();
     void init_sync_structures();
 
+    // blocks until the GPU is done with the frame's previous submission and
+    // records the time spent in stats.fenceWaitTime
+    void wait_for_frame(FrameData& frame);
+    // submits a frame command buffer, signaling the frame timeline and
+    // optionally waiting on/signaling the given binary semaphores
+    void submit_frame(VkCommandBuffer cmd, VkSemaphore waitSemaphore,
+                      VkSemaphore signalSemaphore);
+
+    // transfer timeline value the next frame submission waits on, set when
+    // the frame records the acquires of finished uploads
+    uint64_t _transferWaitValue{0};
+
+    std::vector<ComputePass> _computePasses;
+    // compute timeline value and stages the next frame submission waits on
+    uint64_t _computeWaitValue{0};
+    VkPipelineStageFlags2 _computeWaitStage{VK_PIPELINE_STAGE_2_NONE};
+
+    // records and submits the scheduled compute passes, if any
+    void submit_compute();
+
+    // picks the closest supported mode to the requested one
+    VkPresentModeKHR choose_present_mode(VkPresentModeKHR desired) const;
+    // returns false when the swapchain is out of date and must be recreated
+    bool acquire_swapchain_image(uint32_t& imageIndex);
+
     void create_swapchain(uint32_t width, uint32_t height);
     void destroy_swapchain();
 
     void draw_background(VkCommandBuffer cmd) const;
+    // scales the smaller of the swapchain and the draw image by renderScale
+    void update_draw_extent();
+
+    // groups copies of the same surface into instanced draws and writes
+    // their transforms to the frame ring
+    InstancedDrawList build_instanced_draws(std::span<const RenderObject> draws);
+    // records a range of instanced draws of opaque surfaces. Must be called
+    // inside vkCmdBeginRendering, either inline or in a secondary command
+    // buffer. depthOnly skips transparent surfaces and writes depth only
+    void record_draws(VkCommandBuffer cmd, VkDescriptorSet globalDescriptor,
+                      uint32_t sceneDataOffset,
+                      std::span<const InstancedDraw> draws,
+                      VkDeviceAddress instanceBuffer, bool depthOnly) const;
+    // writes indirect commands and per-draw data to the frame ring, the
+    // list draws every source command until it is culled
+    IndirectDrawList build_indirect_draws(std::span<const RenderObject> draws);
+    // records a cull pass over the source commands and points the list at
+    // its output. Must be called outside of rendering
+    void cull_indirect_draws(VkCommandBuffer cmd, IndirectDrawList& drawList,
+                             CullPhase phase);
+    // grows the per-draw visibility buffer of the occlusion culling
+    void reserve_draw_visibility(VkCommandBuffer cmd, uint32_t drawCount);
+    // must be called inside vkCmdBeginRendering
+    void record_indirect_draws(VkCommandBuffer cmd,
+                               VkDescriptorSet globalDescriptor,
+                               uint32_t sceneDataOffset,
+                               const IndirectDrawList& drawList,
+                               bool depthOnly) const;
+    void set_draw_viewport(VkCommandBuffer cmd) const;
 
     void init_descriptors();
+    // points a scene data set no frame in flight binds at the frame ring
+    void write_scene_data_descriptors();
 
     void init_pipelines();
     void init_imgui();
@@ -225,8 +585,6 @@ private:
 
     void draw_geometry(VkCommandBuffer cmd);
 
-    void destroy_buffer(const AllocatedBuffer& buffer) const;
-
     void resize_swapchain();
 
     void init_mesh_pipeline();
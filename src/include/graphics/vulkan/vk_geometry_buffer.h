@@ -0,0 +1,146 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+// First fit allocator of ranges in [0, capacity). The free list is kept
+// sorted by offset and a freed range merges with its free neighbours, so it
+// never holds two adjacent ranges.
+class RangeAllocator {
+public:
+    void init(uint64_t capacity);
+
+    // offset of a free range of size bytes, nullopt when no hole fits
+    std::optional<uint64_t> allocate(uint64_t size, uint64_t alignment);
+    void free(uint64_t offset, uint64_t size);
+
+    // extends the range, the new space past the old end becomes free
+    void grow(uint64_t capacity);
+
+    uint64_t capacity() const { return _capacity; }
+    uint64_t used() const { return _used; }
+    // end of the last allocation, what a compaction would shrink to used()
+    uint64_t extent() const;
+
+private:
+    // offset to size
+    std::map<uint64_t, uint64_t> _free;
+    uint64_t _capacity{0};
+    uint64_t _used{0};
+};
+
+// a live allocation before and after GeometryBuffer::defragment
+struct GeometryMove {
+    GeometryAllocation from;
+    GeometryAllocation to;
+};
+
+// One vertex buffer and one index buffer shared by every mesh. Meshes get
+// ranges of both from RangeAllocators instead of their own VMA allocations,
+// so all draws bind the same index buffer and address vertices off the same
+// base. Vertex ranges are 16 byte aligned, the largest alignment of the
+// vertex layouts read through buffer references. Both buffers are shared
+// concurrently with the transfer queue family, uploads write new ranges
+// without taking the whole buffer away from the graphics queue.
+//
+// Running out of space grows both buffers, which keeps every offset; freed
+// ranges leave holes until defragment() packs the live ranges together and
+// reports where they went. Both switch to fresh buffers right away and leave
+// the copies to the next frame, record_rebuilds() records them ahead of its
+// draws and retires the old buffers. Neither may run while a frame is being
+// recorded.
+class GeometryBuffer {
+public:
+    // byte range copied from an old buffer into its replacement
+    struct Copy {
+        VkDeviceSize srcOffset;
+        VkDeviceSize dstOffset;
+        VkDeviceSize size;
+    };
+
+    // where defragment() puts the live allocations and the ranges left free
+    struct DefragmentPlan {
+        // every allocation, in vertex offset order
+        std::vector<GeometryMove> moves;
+        std::vector<Copy> vertexCopies;
+        std::vector<Copy> indexCopies;
+        RangeAllocator vertexRanges;
+        RangeAllocator indexRanges;
+    };
+
+    // packs allocations keyed by vertex offset to the front of buffers of
+    // the given capacities. Touches no buffer
+    static DefragmentPlan plan_defragment(
+            const std::map<VkDeviceSize, GeometryAllocation>& allocations,
+            VkDeviceSize vertexCapacity, uint64_t indexCapacity);
+
+    void init(VulkanEngine* vk_engine, VkDeviceSize vertexCapacity,
+              uint32_t indexCapacity);
+    void cleanup();
+
+    GeometryAllocation allocate(VkDeviceSize vertexSize, uint32_t indexCount);
+    void free(const GeometryAllocation& allocation);
+
+    // moves every allocation to the front of the buffers
+    std::vector<GeometryMove> defragment();
+
+    // share of the used extent of the buffers lost to holes, 0 to 1
+    float fragmentation() const;
+
+    // records the copies into buffers replaced since the last call, in
+    // order, and retires the replaced buffers. Called at the start of each
+    // frame after the transfer acquires, so the copies see every upload
+    void record_rebuilds(VkCommandBuffer cmd);
+
+    VkBuffer vertex_buffer() const { return _vertexBuffer.buffer; }
+    VkDeviceAddress vertex_address() const { return _vertexAddress; }
+    VkBuffer index_buffer() const { return _indexBuffer.buffer; }
+
+    VkDeviceSize vertex_used() const { return _vertexRanges.used(); }
+    VkDeviceSize vertex_capacity() const { return _vertexRanges.capacity(); }
+    uint32_t index_used() const {
+        return static_cast<uint32_t>(_indexRanges.used());
+    }
+    uint32_t index_capacity() const {
+        return static_cast<uint32_t>(_indexRanges.capacity());
+    }
+
+private:
+    // buffers replaced by new ones, filled by the next frame
+    struct Rebuild {
+        AllocatedBuffer oldVertexBuffer;
+        AllocatedBuffer oldIndexBuffer;
+        VkBuffer vertexBuffer;
+        VkBuffer indexBuffer;
+        std::vector<Copy> vertexCopies;
+        std::vector<Copy> indexCopies;
+    };
+
+    // replaces the buffers by new ones of the given capacities, which will
+    // hold the copied ranges of the old ones
+    void rebuild(VkDeviceSize vertexCapacity, uint32_t indexCapacity,
+                 std::vector<Copy> vertexCopies,
+                 std::vector<Copy> indexCopies);
+
+    VulkanEngine* _engine{nullptr};
+
+    AllocatedBuffer _vertexBuffer{};
+    VkDeviceAddress _vertexAddress{0};
+    AllocatedBuffer _indexBuffer{};
+
+    // vertex ranges in bytes, index ranges in indices
+    RangeAllocator _vertexRanges;
+    RangeAllocator _indexRanges;
+
+    // live allocations by vertex offset
+    std::map<VkDeviceSize, GeometryAllocation> _allocations;
+
+    std::vector<Rebuild> _rebuilds;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <vulkan/vulkan_core.h>
 
 namespace vkutil {
@@ -10,4 +11,16 @@ void transition_image(VkCommandBuffer cmd, VkImage image,
 void copy_image_to_image(VkCommandBuffer cmd, VkImage source,
                          VkImage destination, VkExtent2D srcSize,
                          VkExtent2D dstSize);
+
+// bytes per texel of the uncompressed color formats, 0 for any other format
+uint32_t format_texel_size(VkFormat format);
+
+// levels of a full mip chain down to 1x1
+uint32_t mip_count(VkExtent2D size);
+
+// fills mips 1 and up from mip 0 with a chain of linear blits, each level
+// from the one above. The image is in TRANSFER_DST_OPTIMAL on entry and in
+// SHADER_READ_ONLY_OPTIMAL afterwards. Needs a graphics queue
+void generate_mipmaps(VkCommandBuffer cmd, VkImage image, VkExtent2D size,
+                      uint32_t mipLevels);
 };  // namespace vkutil
\ No newline at end of file
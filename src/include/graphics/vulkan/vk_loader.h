@@ -22,9 +22,18 @@ struct GLTFMaterial {
 };
 
 struct GeoSurface {
+    // into the shared index buffer once uploaded, see GeometryBuffer
     uint32_t startIndex;
     uint32_t count;
+    Bounds bounds;
     std::shared_ptr<GLTFMaterial> material;
+    // simplified levels after the full one above, coarser and with a larger
+    // error each. Empty unless LODs were generated
+    std::vector<SurfaceLod> lods;
+    // meshlets of the full surface in MeshAsset::meshBuffers, none without
+    // mesh shader support
+    uint32_t firstMeshlet{0};
+    uint32_t meshletCount{0};
 };
 
 struct MeshAsset {
@@ -45,6 +54,12 @@ struct LoadedGLTF final : public IRenderable {
     std::unordered_map<std::string, std::shared_ptr<ENode>> nodes;
     std::unordered_map<std::string, AllocatedImage> images;
     std::unordered_map<std::string, std::shared_ptr<GLTFMaterial>> materials;
+    // every mesh and material of the file, including the unnamed ones the
+    // maps above lose. clearAll frees their GPU resources
+    std::vector<std::shared_ptr<MeshAsset>> meshList;
+    std::vector<std::shared_ptr<GLTFMaterial>> materialList;
+    // images decoded from the file, images above only holds the named ones
+    std::vector<AllocatedImage> imageList;
 
     // nodes that dont have a parent, for iterating through the file in tree
     // order
@@ -52,10 +67,6 @@ struct LoadedGLTF final : public IRenderable {
 
     std::vector<VkSampler> samplers;
 
-    DescriptorAllocatorGrowable descriptorPool;
-
-    AllocatedBuffer materialDataBuffer;
-
     VulkanEngine* creator;
 
     ~LoadedGLTF() {
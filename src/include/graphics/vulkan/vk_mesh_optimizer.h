@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "vk_types.h"
+
+struct GeoSurface;
+
+// meshlets of every surface of a mesh, ready for upload_meshlets
+struct MeshletData {
+    std::vector<GPUMeshlet> meshlets;
+    std::vector<uint32_t> vertices;
+    // three bytes per triangle, padded to a multiple of four
+    std::vector<uint8_t> triangles;
+};
+
+// average cache miss ratio (transformed vertices per triangle) of the index
+// buffer before and after optimize_mesh, for a 16 entry FIFO cache
+struct MeshOptimizeStats {
+    float acmrBefore;
+    float acmrAfter;
+};
+
+namespace vkutil {
+// reorders the triangles of every surface for the post-transform vertex
+// cache, then for less overdraw, then reorders the vertices in first use
+// order so fetches stay local. Surfaces keep their index ranges and the
+// vertices they use, so their bounds stay valid
+MeshOptimizeStats optimize_mesh(std::span<const GeoSurface> surfaces,
+                                std::vector<uint32_t>& indices,
+                                std::vector<Vertex>& vertices);
+
+// appends a chain of simplified index ranges to indices for every surface
+// and records them in GeoSurface::lods. Each level aims at half the
+// triangles of the one before, the chain ends when the simplifier stops
+// making progress. Borders between surfaces are locked so levels of
+// neighbouring surfaces don't open cracks
+void generate_lods(std::span<GeoSurface> surfaces,
+                   std::vector<uint32_t>& indices,
+                   std::span<const Vertex> vertices);
+
+// splits the full index range of every surface into meshlets with bounding
+// spheres and normal cones, and records each surface's meshlet range
+MeshletData build_meshlets(std::span<GeoSurface> surfaces,
+                           std::span<const uint32_t> indices,
+                           std::span<const Vertex> vertices);
+}  // namespace vkutil
@@ -31,9 +31,15 @@ public:
 
     VkPipeline build_pipeline(VkDevice device) const;
 
+    // a null fragment shader builds a depth only pipeline
     void set_shaders(VkShaderModule vertexShader,
                      VkShaderModule fragmentShader);
 
+    // task shader is optional, vertex input and input assembly are ignored
+    // with a mesh shader
+    void set_mesh_shaders(VkShaderModule taskShader, VkShaderModule meshShader,
+                          VkShaderModule fragmentShader);
+
     void set_input_topology(VkPrimitiveTopology topology);
 
     void set_polygon_mode(VkPolygonMode mode);
@@ -44,6 +50,8 @@ public:
 
     void disable_blending();
 
+    void disable_color_writes();
+
     void set_color_attachment_format(VkFormat format);
 
     void set_depth_format(VkFormat format);
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <optional>
+#include <vulkan/vulkan.h>
+
+#include "vk_types.h"
+
+class VulkanEngine;
+
+// sub-allocation from FrameRingBuffer, valid until its frame slot comes
+// around again
+struct RingAllocation {
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void* data;
+    VkDeviceAddress address;
+};
+
+// linear head through one frame's region of a FrameRingBuffer
+class RingRegion {
+public:
+    void reset(VkDeviceSize start, VkDeviceSize size);
+
+    // aligned offset of size bytes, nullopt when they do not fit. Every
+    // request counts towards requested(), fitting or not
+    std::optional<VkDeviceSize> allocate(VkDeviceSize size,
+                                         VkDeviceSize alignment);
+
+    VkDeviceSize used() const { return _head - _start; }
+    // bytes asked for since reset, worst case alignment padding included.
+    // A region this large fits every request
+    VkDeviceSize requested() const { return _requested; }
+
+private:
+    VkDeviceSize _start{0};
+    VkDeviceSize _end{0};
+    VkDeviceSize _head{0};
+    VkDeviceSize _requested{0};
+};
+
+// One persistently mapped host-visible buffer split into a fixed region per
+// frame slot. Each frame bumps a linear head through its own region, so
+// transient data (scene uniforms, per-draw data, indirect commands) costs a
+// pointer increment instead of a VMA allocation. The region of a slot is
+// reused once draw() has waited for that slot.
+//
+// A frame that outgrows its region gets a dedicated buffer for each request
+// that does not fit, and the next begin_frame replaces the ring with one
+// large enough. Frames in flight keep reading the old buffer until the
+// engine retires it.
+class FrameRingBuffer {
+public:
+    void init(VulkanEngine* vk_engine, VkDeviceSize bytesPerFrame,
+              uint32_t frameCount);
+    void cleanup();
+
+    // rewinds the head to the start of the slot's region. Returns true when
+    // the ring grew, buffer() is then a new buffer
+    bool begin_frame(uint32_t frameIndex);
+
+    // alignment 0 uses the device's uniform/storage offset alignment, which
+    // makes the offset usable as a dynamic descriptor offset
+    RingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+    template <typename T>
+    RingAllocation push(const T& value) {
+        RingAllocation allocation = allocate(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation;
+    }
+
+    VkBuffer buffer() const { return _buffer.buffer; }
+    // bytes handed out in the current frame
+    VkDeviceSize used() const { return _region.used(); }
+
+private:
+    // buffer that can hold any sub-allocation, mapped with its address
+    struct Block {
+        AllocatedBuffer buffer;
+        VkDeviceAddress address;
+    };
+    Block create_block(VkDeviceSize size) const;
+    void create_ring(VkDeviceSize bytesPerFrame);
+
+    VulkanEngine* _engine{nullptr};
+    AllocatedBuffer _buffer{};
+    VkDeviceAddress _address{0};
+    std::byte* _mapped{nullptr};
+
+    uint32_t _frameCount{0};
+    VkDeviceSize _bytesPerFrame{0};
+    VkDeviceSize _defaultAlignment{1};
+    // the current frame's region. When the frame asked for more than
+    // _bytesPerFrame the ring grows at the next begin_frame
+    RingRegion _region;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// handle into a SlotMap. The generation tells a live handle apart from a
+// stale one whose slot has been reused
+struct SlotHandle {
+    uint32_t index{UINT32_MAX};
+    uint32_t generation{0};
+
+    bool operator==(const SlotHandle&) const = default;
+};
+
+// Generational slot map that only manages handles. The caller keeps its
+// items in dense arrays indexed by dense_index(), in the same order as the
+// map, so iterating them walks packed memory. Inserting appends to the dense
+// arrays; erasing moves the last item into the hole, which the caller
+// mirrors with a swap and pop.
+//
+// Creating, finding and erasing a handle are O(1) and never allocate once
+// the slot array has grown to the peak item count.
+class SlotMap {
+public:
+    // the new item goes to the back of the dense arrays, at size() - 1
+    SlotHandle insert();
+
+    // dense index of the item, nullopt when the handle is stale
+    std::optional<uint32_t> dense_index(SlotHandle handle) const;
+
+    // dense index the caller has to fill with its last item before popping
+    // it, nullopt when the handle is stale
+    std::optional<uint32_t> erase(SlotHandle handle);
+
+    void clear();
+
+    uint32_t size() const { return static_cast<uint32_t>(_denseToSlot.size()); }
+
+private:
+    struct Slot {
+        uint32_t denseIndex;
+        // odd while the slot holds an item
+        uint32_t generation;
+    };
+
+    std::vector<Slot> _slots;
+    std::vector<uint32_t> _freeSlots;
+    std::vector<uint32_t> _denseToSlot;
+};
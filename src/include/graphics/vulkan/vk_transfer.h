@@ -0,0 +1,113 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <span>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "vk_smart_wrappers.h"
+#include "vk_types.h"
+
+class VulkanEngine;
+
+// completion token of an asynchronous upload, done once the transfer timeline
+// reaches value
+struct UploadTicket {
+    uint64_t value{0};
+};
+
+// copy of a staging range into a buffer at dstOffset. dstStage/dstAccess
+// describe the first use on the graphics queue. The buffer changes queue
+// family ownership unless it is shared, see VulkanEngine::create_shared_buffer.
+// Uploads into a buffer the graphics queue keeps reading elsewhere have to
+// use a shared one
+struct BufferUpload {
+    VkBuffer dst;
+    VkDeviceSize srcOffset;
+    VkDeviceSize size;
+    VkPipelineStageFlags2 dstStage;
+    VkAccessFlags2 dstAccess;
+    VkDeviceSize dstOffset{0};
+    bool shared{false};
+};
+
+// copy of a staging range into mip 0 of a color image. With mipLevels above
+// 1 the other levels are blitted from it on a graphics queue. The whole
+// image ends up in SHADER_READ_ONLY_OPTIMAL
+struct ImageUpload {
+    VkImage image;
+    VkDeviceSize srcOffset;
+    VkExtent3D extent;
+    uint32_t mipLevels{1};
+};
+
+// Asynchronous uploads on a dedicated transfer queue family when the device
+// has one, the graphics queue otherwise. Submissions return a ticket right
+// away; staging buffers are freed in collect() once the GPU is done with
+// them. Written resources change queue family ownership with a release here
+// and an acquire recorded by the next graphics frame (record_acquires), which
+// also waits on the transfer timeline.
+//
+// Not thread safe, upload from the thread that calls draw()
+class TransferQueue {
+public:
+    void init(VulkanEngine* vk_engine, VkQueue queue, uint32_t queueFamily);
+    void cleanup();
+
+    // takes ownership of staging
+    UploadTicket upload_buffers(const AllocatedBuffer& staging,
+                                std::span<const BufferUpload> uploads);
+    UploadTicket upload_images(const AllocatedBuffer& staging,
+                               std::span<const ImageUpload> uploads);
+
+    bool is_complete(UploadTicket ticket) const;
+    void wait(UploadTicket ticket) const;
+
+    // frees staging buffers and recycles command buffers of finished uploads
+    void collect();
+
+    // records queue ownership acquires for everything uploaded since the last
+    // call, and the mip chains of the acquired images. Returns the transfer
+    // timeline value the submission of cmd has to wait for, 0 when there is
+    // nothing new
+    uint64_t record_acquires(VkCommandBuffer cmd);
+
+    VkSemaphore timeline() const { return _timeline->get(); }
+    // true when uploads run on their own queue family and need ownership
+    // transfers
+    bool is_dedicated() const { return _queueFamily != _graphicsQueueFamily; }
+    uint32_t queue_family() const { return _queueFamily; }
+
+private:
+    struct PendingUpload {
+        uint64_t value;
+        VkCommandBuffer cmd;
+        AllocatedBuffer staging;
+    };
+
+    VkCommandBuffer begin_commands();
+    UploadTicket end_commands(VkCommandBuffer cmd,
+                              const AllocatedBuffer& staging);
+    uint64_t completed_value() const;
+
+    VulkanEngine* _engine{nullptr};
+    VkQueue _queue{VK_NULL_HANDLE};
+    uint32_t _queueFamily{0};
+    uint32_t _graphicsQueueFamily{0};
+
+    std::unique_ptr<VulkanCommandPool> _commandPool;
+    std::vector<VkCommandBuffer> _freeCommandBuffers;
+
+    std::unique_ptr<VulkanSemaphore> _timeline;
+    uint64_t _timelineValue{0};
+    // last value already waited on by a graphics submission
+    uint64_t _acquiredValue{0};
+
+    std::deque<PendingUpload> _pending;
+    std::vector<VkBufferMemoryBarrier2> _bufferAcquires;
+    std::vector<VkImageMemoryBarrier2> _imageAcquires;
+    // acquired images whose mips the graphics queue still has to build, a
+    // dedicated transfer family can not blit
+    std::vector<ImageUpload> _pendingMips;
+};
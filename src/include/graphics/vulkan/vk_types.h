@@ -11,7 +11,9 @@
 #include <vector>
 
 #include "core/Logging.h"
+#include "glm/mat3x4.hpp"
 #include "glm/mat4x4.hpp"
+#include "glm/matrix.hpp"
 #include "glm/vec4.hpp"
 #include "vk_mem_alloc.h"
 #include "vulkan/vulkan.h"
@@ -47,17 +49,181 @@ struct Vertex {
     glm::vec4 color;
 };
 
+// compact vertex layout, 20 bytes instead of 48. Mirrors `PackedVertex` in
+// shaders/vertex_packing.glsl
+struct PackedVertex {
+    // snorm16 xyz relative to the mesh bounds, see positionDequant
+    uint32_t positionXY;
+    uint32_t positionZ;
+    // octahedral encoded snorm16x2
+    uint32_t normal;
+    // half float uv
+    uint32_t uv;
+    // unorm8 rgba
+    uint32_t color;
+};
+
+// ranges of a mesh in the shared vertex and index buffers, see
+// GeometryBuffer. Indices are relative to the mesh's first vertex
+struct GeometryAllocation {
+    // in bytes, vertex layouts differ between meshes
+    VkDeviceSize vertexOffset{0};
+    VkDeviceSize vertexSize{0};
+    uint32_t firstIndex{0};
+    uint32_t indexCount{0};
+};
+
 // holds the resources needed for a mesh
 struct GPUMeshBuffers {
-    AllocatedBuffer indexBuffer;
-    AllocatedBuffer vertexBuffer;
-    VkDeviceAddress vertexBufferAddress;
+    GeometryAllocation geometry{};
+    // decode of PackedVertex positions, origin in xyz and scale in w. w is 0
+    // when the buffer holds Vertex
+    glm::vec4 positionDequant{0.f};
+    // GPUMeshlet records, their vertex indices and their packed triangles,
+    // all in meshletBuffer. Null without mesh shader support
+    AllocatedBuffer meshletBuffer{};
+    VkDeviceAddress meshlets{0};
+    VkDeviceAddress meshletVertices{0};
+    VkDeviceAddress meshletTriangles{0};
+};
+
+// meshlets per task shader workgroup, local_size_x of shaders/mesh.task
+constexpr uint32_t MESHLET_TASK_GROUP = 32;
+
+// cluster of up to 64 vertices and 124 triangles of a surface. Mirrors
+// `Meshlet` in shaders/meshlet_structures.glsl
+struct GPUMeshlet {
+    // object space center in xyz, radius in w
+    glm::vec4 boundingSphere;
+    // the meshlet faces away from every camera position p with
+    // dot(normalize(apex - p), axis) >= cutoff
+    glm::vec4 coneApex;
+    // axis in xyz, cutoff in w
+    glm::vec4 coneAxis;
+    // first entry in the meshlet vertex indices
+    uint32_t vertexOffset;
+    // first byte in the meshlet triangles, three vertex indices per triangle
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
 };
 
 // push constants for our mesh object draws
 struct GPUDrawPushConstants {
     glm::mat4 worldMatrix;
+    glm::vec4 positionDequant;
+    VkDeviceAddress vertexBuffer;
+    uint32_t materialIndex;
+};
+
+// push constants of the instanced material draws, each instance reads its
+// transform from the instance buffer at gl_InstanceIndex
+struct GPUInstancedPushConstants {
+    glm::vec4 positionDequant;
+    VkDeviceAddress vertexBuffer;
+    VkDeviceAddress instanceBuffer;
+    uint32_t materialIndex;
+};
+
+// simplified index range of a surface. error is the object space distance
+// the simplified surface may deviate from the full one
+struct SurfaceLod {
+    uint32_t startIndex;
+    uint32_t count;
+    float error;
+};
+
+// push constants of the task and mesh shader draws. One draw covers every
+// instance of a surface, the task shaders cull its meshlets per instance
+struct GPUMeshletPushConstants {
+    glm::vec4 positionDequant;
     VkDeviceAddress vertexBuffer;
+    VkDeviceAddress instanceBuffer;
+    VkDeviceAddress meshlets;
+    VkDeviceAddress meshletVertices;
+    VkDeviceAddress meshletTriangles;
+    uint32_t materialIndex;
+    uint32_t firstMeshlet;
+    uint32_t meshletCount;
+    uint32_t firstInstance;
+    // 1 when the pipeline culls back faces, enables the cone test
+    uint32_t coneCull;
+};
+
+// object space bounds of a surface
+struct Bounds {
+    glm::vec3 origin;
+    float sphereRadius;
+    glm::vec3 extents;
+};
+
+// affine world transform packed as the first three rows of the matrix, 48
+// bytes instead of 64. Shaders read it as a mat3x4 and transform row
+// vectors, `vec4(p, 1) * m` gives the world position
+inline glm::mat3x4 pack_transform(const glm::mat4& m) {
+    return glm::mat3x4(glm::transpose(m));
+}
+
+// per-draw record of the indirect path, indexed with the draw's
+// firstInstance. Mirrors `DrawData` in shaders/mesh_indirect.vert and
+// shaders/cull.comp
+struct GPUDrawData {
+    // see pack_transform
+    glm::mat3x4 worldMatrix;
+    // object space origin in xyz, radius in w
+    glm::vec4 boundingSphere;
+    glm::vec4 positionDequant;
+    VkDeviceAddress vertexBuffer;
+    uint32_t materialIndex;
+    // index of the GPUIndirectBatch the draw belongs to
+    uint32_t batch;
+};
+
+// draw count and first command of one vkCmdDrawIndexedIndirectCount call.
+// The count is read as the call's count buffer
+struct GPUIndirectBatch {
+    uint32_t count;
+    uint32_t first;
+};
+
+// which draws a run of shaders/cull.comp emits
+enum class CullPhase : uint32_t {
+    // every draw inside the frustum
+    Frustum = 0,
+    // draws visible last frame, before the depth pyramid exists
+    OcclusionEarly = 1,
+    // draws that pass the depth pyramid and were not drawn early. Also
+    // stores every draw's visibility for the next frame
+    OcclusionLate = 2,
+};
+
+// input of shaders/cull.comp, read through a buffer address
+struct GPUCullData {
+    glm::vec4 frustum[6];
+    glm::mat4 view;
+    // proj[0][0], proj[1][1], proj[2][2], proj[3][2]
+    glm::vec4 projection;
+    glm::vec2 pyramidSize;
+    // draw extent over depth image extent
+    glm::vec2 pyramidUvScale;
+    VkDeviceAddress drawData;
+    VkDeviceAddress inCommands;
+    VkDeviceAddress outCommands;
+    VkDeviceAddress batches;
+    // one uint per draw, 1 when the draw was visible last frame
+    VkDeviceAddress visibility;
+    uint32_t drawCount;
+    CullPhase phase;
+    float znear;
+};
+
+struct GPUCullPushConstants {
+    VkDeviceAddress cullData;
+};
+
+// push constants of the indirect path
+struct GPUIndirectPushConstants {
+    VkDeviceAddress drawData;
 };
 
 enum class MaterialPass : uint8_t { MainColor, Transparent, Other };
@@ -65,11 +231,14 @@ enum class MaterialPass : uint8_t { MainColor, Transparent, Other };
 struct MaterialPipeline {
     VkPipeline pipeline;
     VkPipelineLayout layout;
+    // meshlet cone culling may only drop what the rasterizer would
+    VkCullModeFlags cullMode{VK_CULL_MODE_NONE};
 };
 
 struct MaterialInstance {
     MaterialPipeline* pipeline;
-    VkDescriptorSet materialSet;
+    // slot in the bindless material table
+    uint32_t materialIndex;
     MaterialPass passType;
 };
 
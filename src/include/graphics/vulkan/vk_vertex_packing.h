@@ -0,0 +1,15 @@
+#pragma once
+
+#include <glm/ext/vector_float4.hpp>
+#include <span>
+#include <vector>
+
+#include "vk_types.h"
+
+// packs vertices into PackedVertex. Positions are quantized relative to the
+// bounding box of the whole span, the returned vec4 holds the decode
+// transform for GPUMeshBuffers::positionDequant: xyz origin, w scale
+namespace vkutil {
+glm::vec4 pack_vertices(std::span<const Vertex> vertices,
+                        std::vector<PackedVertex>& packed);
+}  // namespace vkutil
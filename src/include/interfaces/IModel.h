@@ -39,6 +39,18 @@ public:
      */
     virtual void registerWindow(struct SDL_Window* window) = 0;
 
+    /*!
+     * \brief Initializes Vulkan rendering without a window.
+     *
+     * \param width Width of the offscreen draw image.
+     * \param height Height of the offscreen draw image.
+     *
+     * Frames are rendered into an offscreen image and never presented, so
+     * no display, surface or swapchain is needed. Use instead of
+     * registerWindow().
+     */
+    virtual void registerHeadless(uint32_t width, uint32_t height) = 0;
+
     /*!
      * \brief Updates Vulkan-related states.
      *
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <random>
+
+#include "graphics/vulkan/vk_culling.h"
+
+namespace {
+// reversed 0..1 projection, extract_frustum handles either depth direction
+glm::mat4 reversed_viewproj() {
+    const glm::mat4 view = glm::lookAt(glm::vec3{0.f, 0.f, 5.f},
+                                       glm::vec3{0.f}, glm::vec3{0.f, 1.f, 0.f});
+    const glm::mat4 proj =
+            glm::perspectiveRH_ZO(glm::radians(70.f), 16.f / 9.f, 100.f, 0.1f);
+    return proj * view;
+}
+}  // namespace
+
+TEST(CullingTest, FrustumKeepsCenterDropsBehindAndPastFar) {
+    const Frustum frustum = vkutil::extract_frustum(reversed_viewproj());
+
+    CullSpheres spheres;
+    spheres.push({0.f, 0.f, 0.f, 1.f});     // in front of the camera
+    spheres.push({0.f, 0.f, 10.f, 1.f});    // behind it
+    spheres.push({0.f, 0.f, -200.f, 1.f});  // past the far plane
+    spheres.push({50.f, 0.f, 0.f, 1.f});    // off to the right
+    spheres.push({0.f, 0.f, 6.f, 1.5f});    // crossing the near plane
+
+    std::vector<uint8_t> visible;
+    vkutil::cull_spheres_scalar(frustum, {}, spheres, visible);
+
+    ASSERT_GE(visible.size(), 5u);
+    EXPECT_EQ(visible[0], 1);
+    EXPECT_EQ(visible[1], 0);
+    EXPECT_EQ(visible[2], 0);
+    EXPECT_EQ(visible[3], 0);
+    EXPECT_EQ(visible[4], 1);
+}
+
+TEST(CullingTest, ScreenSizeDropsSmallDistantSpheres) {
+    const Frustum frustum = vkutil::extract_frustum(reversed_viewproj());
+
+    // view depth along -z from the camera at z = 5
+    ScreenSizeCull screenSize{{0.f, 0.f, -1.f, 5.f}, 0.01f};
+
+    CullSpheres spheres;
+    spheres.push({0.f, 0.f, 0.f, 1.f});
+    spheres.push({0.f, 0.f, -90.f, 0.1f});
+
+    std::vector<uint8_t> visible;
+    vkutil::cull_spheres_scalar(frustum, screenSize, spheres, visible);
+
+    EXPECT_EQ(visible[0], 1);
+    EXPECT_EQ(visible[1], 0);
+}
+
+TEST(CullingTest, SimdMatchesScalar) {
+    const Frustum frustum = vkutil::extract_frustum(reversed_viewproj());
+    const ScreenSizeCull screenSize{{0.f, 0.f, -1.f, 5.f}, 0.005f};
+
+    std::mt19937 rng{1234};
+    std::uniform_real_distribution<float> position{-60.f, 60.f};
+    std::uniform_real_distribution<float> radius{0.f, 4.f};
+
+    // not a multiple of four, so the padded tail is covered too
+    CullSpheres spheres;
+    for (int i = 0; i < 1001; i++) {
+        spheres.push({position(rng), position(rng), position(rng), radius(rng)});
+    }
+
+    std::vector<uint8_t> simd;
+    std::vector<uint8_t> scalar;
+    vkutil::cull_spheres(frustum, screenSize, spheres, simd);
+    vkutil::cull_spheres_scalar(frustum, screenSize, spheres, scalar);
+
+    ASSERT_GE(simd.size(), spheres.count);
+    ASSERT_GE(scalar.size(), spheres.count);
+    for (uint32_t i = 0; i < spheres.count; i++) {
+        EXPECT_EQ(simd[i], scalar[i]) << "sphere " << i;
+    }
+}
@@ -0,0 +1,123 @@
+#include <gtest/gtest.h>
+
+#include "graphics/vulkan/vk_geometry_buffer.h"
+
+TEST(RangeAllocatorTest, AllocatesFirstFitAligned) {
+    RangeAllocator ranges;
+    ranges.init(256);
+
+    EXPECT_EQ(ranges.allocate(10, 1), 0u);
+    EXPECT_EQ(ranges.allocate(16, 16), 16u);
+    EXPECT_EQ(ranges.used(), 26u);
+    EXPECT_EQ(ranges.extent(), 32u);
+}
+
+TEST(RangeAllocatorTest, FailsWhenNoHoleFits) {
+    RangeAllocator ranges;
+    ranges.init(64);
+
+    EXPECT_EQ(ranges.allocate(48, 1), 0u);
+    EXPECT_FALSE(ranges.allocate(32, 1).has_value());
+    EXPECT_EQ(ranges.allocate(16, 1), 48u);
+    EXPECT_FALSE(ranges.allocate(1, 1).has_value());
+}
+
+TEST(RangeAllocatorTest, FreeReusesHole) {
+    RangeAllocator ranges;
+    ranges.init(96);
+
+    const uint64_t a = *ranges.allocate(32, 1);
+    ranges.allocate(32, 1);
+    ranges.free(a, 32);
+
+    EXPECT_EQ(ranges.used(), 32u);
+    EXPECT_EQ(ranges.allocate(32, 1), a);
+}
+
+TEST(RangeAllocatorTest, FreeCoalescesNeighbours) {
+    RangeAllocator ranges;
+    ranges.init(96);
+
+    const uint64_t a = *ranges.allocate(32, 1);
+    const uint64_t b = *ranges.allocate(32, 1);
+    const uint64_t c = *ranges.allocate(32, 1);
+
+    // the middle range merges with both sides into one hole of 96 bytes
+    ranges.free(a, 32);
+    ranges.free(c, 32);
+    ranges.free(b, 32);
+
+    EXPECT_EQ(ranges.used(), 0u);
+    EXPECT_EQ(ranges.allocate(96, 1), 0u);
+}
+
+TEST(RangeAllocatorTest, GrowAddsFreeSpaceAtEnd) {
+    RangeAllocator ranges;
+    ranges.init(32);
+
+    ranges.allocate(16, 1);
+    ranges.allocate(16, 1);
+    ranges.grow(64);
+
+    EXPECT_EQ(ranges.capacity(), 64u);
+    EXPECT_EQ(ranges.allocate(32, 1), 32u);
+}
+
+TEST(RangeAllocatorTest, GrowMergesWithTrailingHole) {
+    RangeAllocator ranges;
+    ranges.init(32);
+
+    ranges.allocate(16, 1);
+    ranges.grow(64);
+
+    EXPECT_EQ(ranges.allocate(48, 1), 16u);
+}
+
+TEST(GeometryDefragmentTest, PacksAllocationsToFront) {
+    std::map<VkDeviceSize, GeometryAllocation> allocations;
+    allocations[32] = {32, 16, 10, 6};
+    allocations[96] = {96, 32, 2, 3};
+
+    const GeometryBuffer::DefragmentPlan plan =
+            GeometryBuffer::plan_defragment(allocations, 256, 64);
+
+    // vertices keep their vertex offset order, indices their index order
+    ASSERT_EQ(plan.moves.size(), 2u);
+    EXPECT_EQ(plan.moves[0].to.vertexOffset, 0u);
+    EXPECT_EQ(plan.moves[1].to.vertexOffset, 16u);
+    EXPECT_EQ(plan.moves[1].to.firstIndex, 0u);
+    EXPECT_EQ(plan.moves[0].to.firstIndex, 3u);
+
+    EXPECT_EQ(plan.vertexRanges.used(), 48u);
+    EXPECT_EQ(plan.vertexRanges.extent(), 48u);
+    EXPECT_EQ(plan.indexRanges.used(), 9u);
+    EXPECT_EQ(plan.indexRanges.extent(), 9u);
+}
+
+TEST(GeometryDefragmentTest, CopiesCoverEveryAllocation) {
+    std::map<VkDeviceSize, GeometryAllocation> allocations;
+    allocations[64] = {64, 32, 20, 4};
+
+    const GeometryBuffer::DefragmentPlan plan =
+            GeometryBuffer::plan_defragment(allocations, 128, 32);
+
+    ASSERT_EQ(plan.vertexCopies.size(), 1u);
+    EXPECT_EQ(plan.vertexCopies[0].srcOffset, 64u);
+    EXPECT_EQ(plan.vertexCopies[0].dstOffset, 0u);
+    EXPECT_EQ(plan.vertexCopies[0].size, 32u);
+
+    // index copies are in bytes
+    ASSERT_EQ(plan.indexCopies.size(), 1u);
+    EXPECT_EQ(plan.indexCopies[0].srcOffset, 20 * sizeof(uint32_t));
+    EXPECT_EQ(plan.indexCopies[0].dstOffset, 0u);
+    EXPECT_EQ(plan.indexCopies[0].size, 4 * sizeof(uint32_t));
+}
+
+TEST(GeometryDefragmentTest, KeepsCapacity) {
+    const GeometryBuffer::DefragmentPlan plan =
+            GeometryBuffer::plan_defragment({}, 128, 32);
+
+    EXPECT_TRUE(plan.moves.empty());
+    EXPECT_EQ(plan.vertexRanges.capacity(), 128u);
+    EXPECT_EQ(plan.indexRanges.capacity(), 32u);
+}
@@ -0,0 +1,73 @@
+#include <gtest/gtest.h>
+
+#include "graphics/vulkan/vk_ring_buffer.h"
+
+TEST(RingRegionTest, AlignsOffsets) {
+    RingRegion region;
+    region.reset(256, 256);
+
+    EXPECT_EQ(region.allocate(4, 4), 256u);
+    EXPECT_EQ(region.allocate(8, 64), 320u);
+    EXPECT_EQ(region.allocate(1, 1), 328u);
+    EXPECT_EQ(region.used(), 73u);
+}
+
+TEST(RingRegionTest, OverflowReturnsNullopt) {
+    RingRegion region;
+    region.reset(0, 64);
+
+    EXPECT_EQ(region.allocate(48, 16), 0u);
+    EXPECT_FALSE(region.allocate(32, 16).has_value());
+    // a failed request leaves the head alone
+    EXPECT_EQ(region.allocate(16, 16), 48u);
+    EXPECT_FALSE(region.allocate(1, 1).has_value());
+}
+
+TEST(RingRegionTest, NeverPassesRegionEnd) {
+    RingRegion region;
+    region.reset(64, 64);
+
+    // the aligned offset would fit, the end of the data would not
+    region.allocate(40, 1);
+    EXPECT_FALSE(region.allocate(17, 16).has_value());
+    EXPECT_EQ(region.allocate(16, 16), 112u);
+}
+
+TEST(RingRegionTest, RequestedCountsFailedRequests) {
+    RingRegion region;
+    region.reset(0, 32);
+
+    region.allocate(16, 16);
+    region.allocate(64, 16);
+
+    EXPECT_EQ(region.requested(), 16u + 15u + 64u + 15u);
+    EXPECT_EQ(region.used(), 16u);
+}
+
+TEST(RingRegionTest, RequestedBytesFitEveryRequest) {
+    RingRegion region;
+    region.reset(0, 16);
+
+    const VkDeviceSize sizes[] = {3, 40, 7, 100};
+    for (const VkDeviceSize size : sizes) {
+        region.allocate(size, 64);
+    }
+
+    // a region of requested() bytes at any start takes the same requests
+    const VkDeviceSize requested = region.requested();
+    region.reset(1, requested);
+    for (const VkDeviceSize size : sizes) {
+        EXPECT_TRUE(region.allocate(size, 64).has_value());
+    }
+}
+
+TEST(RingRegionTest, ResetStartsOver) {
+    RingRegion region;
+    region.reset(0, 32);
+    region.allocate(32, 1);
+
+    region.reset(32, 32);
+    EXPECT_EQ(region.used(), 0u);
+    EXPECT_EQ(region.requested(), 0u);
+    EXPECT_EQ(region.allocate(32, 1), 32u);
+}
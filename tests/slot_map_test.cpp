@@ -0,0 +1,74 @@
+#include <gtest/gtest.h>
+
+#include "graphics/vulkan/vk_slot_map.h"
+
+TEST(SlotMapTest, InsertAppendsDense) {
+    SlotMap map;
+
+    const SlotHandle a = map.insert();
+    const SlotHandle b = map.insert();
+
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map.dense_index(a), 0u);
+    EXPECT_EQ(map.dense_index(b), 1u);
+}
+
+TEST(SlotMapTest, DefaultHandleIsStale) {
+    SlotMap map;
+    map.insert();
+
+    EXPECT_FALSE(map.dense_index(SlotHandle{}).has_value());
+    EXPECT_FALSE(map.erase(SlotHandle{}).has_value());
+}
+
+TEST(SlotMapTest, EraseMovesLastIntoHole) {
+    SlotMap map;
+
+    const SlotHandle a = map.insert();
+    const SlotHandle b = map.insert();
+    const SlotHandle c = map.insert();
+
+    EXPECT_EQ(map.erase(a), 0u);
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map.dense_index(c), 0u);
+    EXPECT_EQ(map.dense_index(b), 1u);
+}
+
+TEST(SlotMapTest, EraseStalesHandle) {
+    SlotMap map;
+
+    const SlotHandle a = map.insert();
+    map.erase(a);
+
+    EXPECT_FALSE(map.dense_index(a).has_value());
+    EXPECT_FALSE(map.erase(a).has_value());
+    EXPECT_EQ(map.size(), 0u);
+}
+
+TEST(SlotMapTest, ReusedSlotGetsNewGeneration) {
+    SlotMap map;
+
+    const SlotHandle a = map.insert();
+    map.erase(a);
+    const SlotHandle b = map.insert();
+
+    EXPECT_EQ(b.index, a.index);
+    EXPECT_NE(b.generation, a.generation);
+    EXPECT_FALSE(map.dense_index(a).has_value());
+    EXPECT_EQ(map.dense_index(b), 0u);
+}
+
+TEST(SlotMapTest, ClearStalesEveryHandle) {
+    SlotMap map;
+
+    const SlotHandle a = map.insert();
+    const SlotHandle b = map.insert();
+    map.clear();
+
+    EXPECT_EQ(map.size(), 0u);
+    EXPECT_FALSE(map.dense_index(a).has_value());
+    EXPECT_FALSE(map.dense_index(b).has_value());
+
+    const SlotHandle c = map.insert();
+    EXPECT_EQ(map.dense_index(c), 0u);
+}
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/geometric.hpp>
+#include <glm/gtc/packing.hpp>
+#include <vector>
+
+#include "graphics/vulkan/vk_vertex_packing.h"
+
+namespace {
+// decode_octahedral of vertex_packing.glsl
+glm::vec3 decode_octahedral(glm::vec2 e) {
+    glm::vec3 n{e.x, e.y, 1.f - std::abs(e.x) - std::abs(e.y)};
+    const float t = std::max(-n.z, 0.f);
+    n.x += n.x >= 0.f ? -t : t;
+    n.y += n.y >= 0.f ? -t : t;
+    return glm::normalize(n);
+}
+
+Vertex make_vertex(glm::vec3 position, glm::vec3 normal, glm::vec2 uv,
+                   glm::vec4 color) {
+    return {position, uv.x, glm::normalize(normal), uv.y, color};
+}
+}  // namespace
+
+TEST(VertexPackingTest, EmptySpanIsIdentity) {
+    std::vector<PackedVertex> packed{PackedVertex{}};
+    const glm::vec4 dequant = vkutil::pack_vertices({}, packed);
+
+    EXPECT_TRUE(packed.empty());
+    EXPECT_EQ(dequant, glm::vec4(0.f, 0.f, 0.f, 1.f));
+}
+
+TEST(VertexPackingTest, RoundTripsWithinQuantization) {
+    const std::vector<Vertex> vertices = {
+            make_vertex({-3.f, 1.f, 0.5f}, {0.f, 1.f, 0.f}, {0.f, 0.f},
+                        {1.f, 0.f, 0.f, 1.f}),
+            make_vertex({7.f, -2.f, 4.f}, {0.3f, -0.4f, -0.8f}, {1.f, 0.5f},
+                        {0.f, 1.f, 0.f, 0.5f}),
+            make_vertex({0.25f, 9.f, -6.f}, {-1.f, -1.f, -1.f}, {0.25f, 2.f},
+                        {0.2f, 0.4f, 0.6f, 0.f}),
+            make_vertex({1.f, 1.f, 1.f}, {0.f, 0.f, -1.f}, {-1.f, 0.75f},
+                        {1.f, 1.f, 1.f, 1.f}),
+    };
+
+    std::vector<PackedVertex> packed;
+    const glm::vec4 dequant = vkutil::pack_vertices(vertices, packed);
+    ASSERT_EQ(packed.size(), vertices.size());
+
+    // snorm16 steps over the largest half extent
+    const float positionTolerance = dequant.w / 32767.f;
+    for (size_t i = 0; i < vertices.size(); i++) {
+        const Vertex& v = vertices[i];
+        const PackedVertex& p = packed[i];
+
+        const glm::vec2 xy = glm::unpackSnorm2x16(p.positionXY);
+        const float z = glm::unpackSnorm2x16(p.positionZ).x;
+        const glm::vec3 position =
+                glm::vec3{xy, z} * dequant.w + glm::vec3{dequant};
+        EXPECT_NEAR(position.x, v.position.x, positionTolerance);
+        EXPECT_NEAR(position.y, v.position.y, positionTolerance);
+        EXPECT_NEAR(position.z, v.position.z, positionTolerance);
+
+        const glm::vec3 normal =
+                decode_octahedral(glm::unpackSnorm2x16(p.normal));
+        EXPECT_GT(glm::dot(normal, v.normal), 0.9999f);
+
+        const glm::vec2 uv = glm::unpackHalf2x16(p.uv);
+        EXPECT_NEAR(uv.x, v.uv_x, 1e-3f);
+        EXPECT_NEAR(uv.y, v.uv_y, 1e-3f);
+
+        const glm::vec4 color = glm::unpackUnorm4x8(p.color);
+        for (int c = 0; c < 4; c++) {
+            EXPECT_NEAR(color[c], v.color[c], 0.5f / 255.f + 1e-6f);
+        }
+    }
+}
+
+TEST(VertexPackingTest, FlatMeshKeepsScalePositive) {
+    // every vertex in one point, the bounds have no extent at all
+    const std::vector<Vertex> vertices(
+            3, make_vertex({2.f, 2.f, 2.f}, {0.f, 0.f, 1.f}, {0.f, 0.f},
+                           {1.f, 1.f, 1.f, 1.f}));
+
+    std::vector<PackedVertex> packed;
+    const glm::vec4 dequant = vkutil::pack_vertices(vertices, packed);
+
+    EXPECT_GT(dequant.w, 0.f);
+    EXPECT_EQ(glm::vec3(dequant), glm::vec3(2.f));
+}